@@ -12,6 +12,8 @@ Cloth::Cloth() {
 	mass = 5.0f;
 	k = 1000;
 	kv = 100;
+	k_shear = 0.0f;
+	k_bend = 0.0f;
 
 	init();
 }
@@ -25,23 +27,63 @@ Cloth::Cloth(int l, int w, float g, float len, float m, float k_p, float kv_p) {
 	mass = m;
 	k = k_p;
 	kv = kv_p;
+	k_shear = 0.0f;
+	k_bend = 0.0f;
 
 	init();
 }
 
 void Cloth::init() {
+	dims.length = length;
+	dims.width = width;
 	glm::vec3 upperleft((length - 1) * restlen / 2.0f, 0.0f, (width - 1) * restlen); //coordinate of the upper left corner
 
 	for (int i = 0; i < length; i++) {
 		for (int j = 0; j < width; j++) {
 			pos.push_back(glm::vec3(upperleft.x - i * restlen, upperleft.y + j * restlen, upperleft.z));
-			normal.push_back(glm::vec3(0.0f));
 			vel.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
 		}
 	}
 
+	// force buffers are sized once here so update() never allocates
+	vforce.assign(length * (width - 1), glm::vec3(0.0f));
+	hforce.assign((length - 1) * width, glm::vec3(0.0f));
+	gforce.assign(length * width, glm::vec3(0.0f));
+	tforce.assign(2 * (length - 1) * (width - 1), glm::vec3(0.0f));
+
+	// normals are padded to whole SIMD registers, the padding is a valid unit vector
+	int padded = (length * width + simd::lanes - 1) / simd::lanes * simd::lanes;
+	nx.assign(padded, 1.0f);
+	ny.assign(padded, 0.0f);
+	nz.assign(padded, 0.0f);
+	tri_normal.assign(2 * (length - 1) * (width - 1), glm::vec3(0.0f));
+	normals_valid = false;
+
 	wind_v = glm::vec3(0.0f); // no wind initially
+	wind_speed = 0.0f;
 	//wind_v = glm::vec3(-10.0f, -10.0f, 0.0f);
+
+	obs_known = false;
+	collider_dt = 1.0f;
+	adaptive = false;
+	min_substep = 1;
+	last_substep = 0;
+	row_speed.assign(length, 0.0f);
+	layout = storage::aos;
+	method = integrator::explicit_euler;
+	init_soa();
+	init_implicit();
+	init_springs();
+	init_self_collision();
+	strain_limit = 0.0f;
+	strain_iter = 1;
+	sleeping = false;
+	init_sleep();
+	init_pins();
+	init_wind();
+	set_refinement(1);
+	xpbd_mode = xpbd_solve::gauss_seidel;
+	xpbd_iter = 10;
 }
 
 vector<float> Cloth::vertex_buffer() {
@@ -56,16 +98,17 @@ vector<float> Cloth::vertex_buffer() {
 
 vector<int> Cloth::get_index() {
 	vector<int> index_buffer;
-	for (int i = 0; i < length - 1; i++) {
-		for (int j = 0; j < width - 1; j++) {
+	int rl = render_length(), rw = render_width();
+	for (int i = 0; i < rl - 1; i++) {
+		for (int j = 0; j < rw - 1; j++) {
 			// first triangle index
-			index_buffer.push_back(i * width + j);
-			index_buffer.push_back(i * width + 1 + j);
-			index_buffer.push_back((i + 1) * width + 1 + j);
+			index_buffer.push_back(i * rw + j);
+			index_buffer.push_back(i * rw + 1 + j);
+			index_buffer.push_back((i + 1) * rw + 1 + j);
 			// second triangle index
-			index_buffer.push_back(i * width + j);
-			index_buffer.push_back((i + 1) * width + 1 + j);
-			index_buffer.push_back((i + 1) * width + j);
+			index_buffer.push_back(i * rw + j);
+			index_buffer.push_back((i + 1) * rw + 1 + j);
+			index_buffer.push_back((i + 1) * rw + j);
 		}
 	}
 	return index_buffer;
@@ -73,207 +116,255 @@ vector<int> Cloth::get_index() {
 
 vector<float> Cloth::get_uv() {
 	vector<float> uvs;
-	for (int i = 0; i < length; i++) {
-		for (int j = 0; j < width; j++) {
-			uvs.push_back(i / float(length - 1)); // u
-			//uvs.push_back((width - j) / float(width - 1)); // v
-			uvs.push_back(j / float(width - 1)); // v
+	int rl = render_length(), rw = render_width();
+	for (int i = 0; i < rl; i++) {
+		for (int j = 0; j < rw; j++) {
+			uvs.push_back(i / float(rl - 1)); // u
+			//uvs.push_back((rw - j) / float(rw - 1)); // v
+			uvs.push_back(j / float(rw - 1)); // v
 		}
 	}
 	return uvs;
 }
 
 vector<float> Cloth::get_normal() {
+	update_normals();
 	vector<float> result;
-	glm::vec3 n;
+	for (int i = 0; i < length * width; i++) {
+		result.push_back(nx[i]);
+		result.push_back(ny[i]);
+		result.push_back(nz[i]);
+	}
+	return result;
+}
+
+// the normals are only needed for rendering, so update() just marks them stale and they are
+// computed here on the first request: unit normal of every triangle, the sum of the ones around
+// every vertex, and one vectorized pass that normalizes them all
+void Cloth::update_normals() const {
+	if (normals_valid) return;
+
+	int nq = (length - 1) * (width - 1);
+	#pragma omp parallel for
+	for (int q = 0; q < nq; q++) {
+		int i = q / (width - 1), j = q % (width - 1);
+		int ind0 = i * width + j;
+		int ind1 = i * width + j + 1;
+		int ind2 = (i + 1) * width + j + 1;
+		int ind3 = (i + 1) * width + j;
+		glm::vec3 diag = pos[ind2] - pos[ind0];
+		tri_normal[2 * q] = glm::normalize(glm::cross(pos[ind1] - pos[ind0], diag));
+		tri_normal[2 * q + 1] = glm::normalize(glm::cross(diag, pos[ind3] - pos[ind0]));
+	}
+
+	#pragma omp parallel for
 	for (int i = 0; i < length; i++) {
 		for (int j = 0; j < width; j++) {
-			n = glm::normalize(normal[i * width + j]);
-			result.push_back(n.x);
-			result.push_back(n.y);
-			result.push_back(n.z);
+			glm::vec3 n = gather_triangles(tri_normal, i, j);
+			nx[i * width + j] = n.x;
+			ny[i * width + j] = n.y;
+			nz[i * width + j] = n.z;
 		}
 	}
-	return result;
+
+	int padded = nx.size();
+	#pragma omp parallel for
+	for (int i = 0; i < padded; i += simd::lanes) {
+		simd::vfloat x = simd::load<simd::vfloat>(nx.data() + i);
+		simd::vfloat y = simd::load<simd::vfloat>(ny.data() + i);
+		simd::vfloat z = simd::load<simd::vfloat>(nz.data() + i);
+		simd::vfloat len = simd::sqrt(simd::madd(x, x, simd::madd(y, y, simd::mul(z, z))));
+		simd::store(nx.data() + i, simd::div(x, len));
+		simd::store(ny.data() + i, simd::div(y, len));
+		simd::store(nz.data() + i, simd::div(z, len));
+	}
+	normals_valid = true;
 }
 
-void Cloth::update(float total_dt, int substep, glm::vec3 obs_loc, float obs_rad) {
+int Cloth::render_floats() const {
+	return 6 * render_length() * render_width();
+}
 
-	vector<glm::vec3> vforce; // forces in the vertical strings
-	vector<glm::vec3> hforce; // forces in horizontal strings
-	vector<glm::vec3> gforce; // drag force
+// out may be a mapped GL buffer, so every float is written exactly once and nothing is read back
+void Cloth::write_render(float* out) const {
+	if (refine > 1) {
+		write_refined(out);
+		return;
+	}
+	update_normals();
+	int n = length * width;
 	#pragma omp parallel for
-	for (int i = 0; i < width * length; i++) gforce.push_back(glm::vec3(0.0f));
-	bool update_normals = false;
+	for (int i = 0; i < n; i++) {
+		glm::vec3 p = pos[i];
+		float* v = out + 6 * i;
+		v[0] = p.x; v[1] = p.y; v[2] = p.z;
+		v[3] = nx[i]; v[4] = ny[i]; v[5] = nz[i];
+	}
+}
+
+void Cloth::update(float total_dt, int substep, glm::vec3 obs_loc, float obs_rad) {
+
+	sc_broad_ms = 0.0;
+	sc_narrow_ms = 0.0;
+	normals_valid = false; // recomputed when they are asked for
 
-	// compute forces
-	float stringF; // elastic force in the string
-	float dampF; // damping force in the string
+	// the sphere moves from where it was in the last update to obs_loc over this frame,
+	// so a fast sphere is swept through the substeps instead of jumping at the first one
+	glm::vec3 obs_from = obs_known ? obs_prev : obs_loc;
+	obs_prev = obs_loc;
+	obs_known = true;
 
-	glm::vec3 delta_p;
-	float v1, v2;
+	if (adaptive) substep = pick_substeps(total_dt, substep, obs_from, obs_loc);
+	last_substep = substep;
+	start_attached();
+	collider_dt = total_dt; // the mesh colliders moved since the last update over this frame
+
+	if (method == integrator::implicit_euler) { // large steps, solved with conjugate gradient
+		update_implicit(total_dt, substep, obs_from, obs_loc, obs_rad);
+	}
+	else if (method == integrator::xpbd) { // strings as compliant distance constraints
+		update_xpbd(total_dt, substep, obs_from, obs_loc, obs_rad);
+	}
+	else {
+		bool can_sleep = sleeping && (waves.empty() || wind_speed == 0.0f); // gusts reach every tile sooner or later
+		if (can_sleep) wake_tiles(obs_from, obs_loc, obs_rad);
+		if (layout == storage::soa && !self_collision) // separate x/y/z arrays with vectorized kernels (self-collision works on pos)
+			update_soa(total_dt, substep, obs_from, obs_loc, obs_rad);
+		else
+			update_aos(total_dt, substep, obs_from, obs_loc, obs_rad);
+		if (can_sleep) sleep_tiles(total_dt, obs_from, obs_loc, obs_rad);
+	}
+
+	for (MeshBVH& c : colliders) c.settle(); // their moves are used up, until the next move_collider they stand still
+}
+
+void Cloth::update_aos(float total_dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad) {
 
 	float dt = total_dt / substep;
 	
 	for (int step = 0; step < substep; step++) {
 
-		// reset all the forces (& normals)
-		vforce.clear();
-		hforce.clear();
-		for (int i = 0; i < width * length; i++) gforce[i] = glm::vec3(0.0f);
-
-		if (step == substep - 1) update_normals = true; // only update normals in the final substep
+		glm::vec3 obs0 = obs_at(obs_from, obs_loc, step, substep);
+		glm::vec3 obs1 = obs_at(obs_from, obs_loc, step + 1, substep);
+
+		// springs and wind, then the strings, drag, Eulerian integration & collision detection of every vertex
+		spring_batch_forces();
+		advance_wind(dt, false);
+		cloth_kernels::explicit_state<float> s = { pos.data(), vel.data(), vforce.data(), hforce.data(), tforce.data(), gforce.data(),
+			sforce.data(), inv_mass.data(), free_mask.data(), active.data() };
+		cloth_kernels::explicit_substep<float>(dims, s, k, kv, restlen, gravity, dt,
+			[this](int q, glm::vec3& w0, glm::vec3& w1) { quad_wind(q, w0, w1); },
+			[&](int ind, glm::vec3 start) { collide(ind, start, obs0, obs1, obs_rad, dt); });
+
+		move_attached(step, substep, total_dt, false);
+		limit_strain(false);
+		self_collide();
+	}
 
-		// vertical
-		#pragma omp parallel for
-		for (int i = 0; i < length; i++) {
-			for (int j = 0; j < width - 1; j++) {
-				delta_p = pos[i * width + j + 1] - pos[i * width + j];
-				float len = glm::length(delta_p); // len is the distance between two vertical conjunctions
-				stringF = -k * (len - restlen);
+}
 
-				delta_p = glm::normalize(delta_p); // delta_p is now the unit direction
-				v1 = glm::dot(vel[i * width + j], delta_p);
-				v2 = glm::dot(vel[i * width + j + 1], delta_p);
-				dampF = kv * (v1 - v2);
+// compute the force in every string, skipping the ones between two sleeping vertices
+void Cloth::spring_forces() {
+	cloth_kernels::string_forces<float>(dims, pos.data(), vel.data(), vforce.data(), hforce.data(), k, kv, restlen, active.data());
+}
 
-				vforce.push_back((stringF + dampF) * delta_p);
-			}
-		}
+glm::vec3 Cloth::string_force(int a, int b, float ks, float kd, float rest) const {
+	return cloth_kernels::string_force<float>(pos.data(), vel.data(), a, b, ks, kd, rest);
+}
 
-		// horizontal
-		#pragma omp parallel for
-		for (int i = 0; i < length - 1; i++) {
-			for (int j = 0; j < width; j++) {
-				delta_p = pos[(i + 1) * width + j] - pos[i * width + j];
-				float len = glm::length(delta_p); // len is the distance between two vertical conjunctions
-				stringF = -k * (len - restlen);
-
-				delta_p = glm::normalize(delta_p); // delta_p is now the unit direction
-				v1 = glm::dot(vel[i * width + j], delta_p);
-				v2 = glm::dot(vel[(i + 1) * width + j], delta_p);
-				dampF = kv * (v1 - v2);
-
-				hforce.push_back((stringF + dampF) * delta_p);
-				//hforce.push_back((stringF) * delta_p);
-			}
-		}
+glm::vec3 Cloth::gather(const vector<glm::vec3>& v, const vector<glm::vec3>& h, int i, int j) const {
+	return cloth_kernels::gather<float>(dims, v.data(), h.data(), i, j);
+}
 
-		// drag (& normal)
-		drag(gforce, update_normals);
-
-		// Eulerian integration & collision detection
-		#pragma omp parallel for
-		for (int i = 0; i < length; i++) { // for each conjunctions
-			for (int j = 0; j < width; j++) {
-				if (j == 0) {
-					if (i == 0 || i == length/3 || i == 2*length/3 || i == length - 1) continue; // exclude the pins
-				}
-				// compute the acceleration
-				glm::vec3 acc(0.0f);
-				// string force
-				// force from upper string
-				if (j > 0) {
-					acc += vforce[i * (width - 1) + j - 1];
-				}
-				// force from lower string
-				if (j < width - 1) {
-					acc -= vforce[i * (width - 1) + j];
-				}
-				// force from left string
-				if (i > 0) {
-					acc += hforce[(i - 1) * width + j];
-				}
-				// force from right string
-				if (i < length - 1) {
-					acc -= hforce[i * width + j];
-				}
-				// convert force to acceleration
-				acc = acc * 0.5f / mass;
-
-				// drag
-				acc += gforce[i * width + j] / mass;
-
-				// gravity
-				acc.z += gravity;
-
-				// update speed and position
-				vel[i * width + j] += acc * dt;
-				pos[i * width + j] += vel[i * width + j] * dt;
-
-				// collision detection
-				glm::vec3 n = pos[i * width + j] - obs_loc;
-				if (glm::length(n) <= obs_rad + 0.1) { // collided
-
-					float alpha = 0.1f;
-					n = glm::normalize(n);
-					pos[i * width + j] = obs_loc + (obs_rad + 0.2f) * n;
-
-					float vns = glm::dot(vel[i * width + j], n); // velocity parallel to normal
-					glm::vec3 vtemp = -(1 + alpha) * vns * n;
-					vel[i * width + j] += vtemp;
-				}
-			}
-		}
+// the most substeps needed by either of
+// - stability: the explicit solver must keep h below the limit of symplectic Euler on the stiffest
+//   mode, a string chain with 4 k / m and 4 kv / m per unit mass, where 4 - 2 h d - h^2 w^2 > 0
+//   (the implicit and XPBD solvers have no such limit)
+// - motion: no vertex, and not the sphere, moves more than a quarter of the rest length per substep
+int Cloth::pick_substeps(float total_dt, int max_substep, glm::vec3 obs_from, glm::vec3 obs_loc) {
+	int needed = min_substep;
+
+	float w2 = 4.0f * 0.5f * (k + k_shear + k_bend) / min_mass; // the solver halves the string forces
+	if (method == integrator::explicit_euler && w2 > 0.0f) {
+		float d = 4.0f * 0.5f * (kv + spring_damping(k_shear) + spring_damping(k_bend)) / min_mass;
+		float h_max = (sqrt(d * d + 4.0f * w2) - d) / w2;
+		float safety = 0.7f; // collisions and the nonlinear strings eat into the linear limit
+		needed = glm::max(needed, int(ceil(total_dt / (safety * h_max))));
+	}
 
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		float fastest = 0.0f;
+		for (int j = 0; j < width; j++) fastest = glm::max(fastest, glm::dot(vel[i * width + j], vel[i * width + j]));
+		row_speed[i] = fastest;
 	}
+	float speed = 0.0f;
+	for (int i = 0; i < length; i++) speed = glm::max(speed, row_speed[i]);
+	speed = sqrt(speed) + glm::length(obs_loc - obs_from) / total_dt;
+	needed = glm::max(needed, int(ceil(speed * total_dt / (0.25f * restlen))));
 
+	return glm::min(needed, max_substep);
 }
 
-void Cloth::drag(vector<glm::vec3>& gforce, bool comp_normal) {
-	float c = 2.0f;
-	if (comp_normal) { // if we need to update normals
-		#pragma omp parallel for
-		for (int i = 0; i < width * length; i++) { // we reset all the normals first
-			normal[i] = glm::vec3(0.0f);
-		}
-	}
-	#pragma omp parallel for
-	for (int i = 0; i < length - 1; i++) {
-		for (int j = 0; j < width - 1; j++) {
-
-			// find the indices
-			int ind0 = i * width + j;
-			int ind1 = i * width + j + 1;
-			int ind2 = (i + 1) * width + j + 1;
-			int ind3 = (i + 1) * width + j;
-
-			// compute average vel for triangles
-			glm::vec3 vtmp = vel[ind0] + vel[ind2];
-			glm::vec3 v0 = (vtmp + vel[ind1]) / 3.0f - wind_v; // average vel for the 1st triangle
-			glm::vec3 v1 = (vtmp + vel[ind3]) / 3.0f - wind_v; // ... for the 2nd triangle
-
-			// compute normal for triangles
-			vtmp = pos[ind2] - pos[ind0]; // diagonal vector
-			glm::vec3 n0 = glm::cross(pos[ind1] - pos[ind0], vtmp); // unnormalized normal
-			glm::vec3 n1 = glm::cross(vtmp, pos[ind3] - pos[ind0]);
-
-			// compute the final force
-			glm::vec3 f0 = -0.5f * c * (glm::length(v0) * glm::dot(v0, n0) / (2.0f * glm::length(n0))) * n0; // force on each triangle
-			glm::vec3 f1 = -0.5f * c * (glm::length(v1) * glm::dot(v1, n1) / (2.0f * glm::length(n1))) * n1;
-			f0 /= 3.0f; // force per vertex
-			f1 /= 3.0f;
-			gforce[ind0] += f0;
-			gforce[ind1] += f0;
-			gforce[ind2] += f0;
-			gforce[ind0] += f1;
-			gforce[ind2] += f1;
-			gforce[ind3] += f1;
-
-			if (comp_normal) { // update the normals if we need to
-				n0 = glm::normalize(n0);
-				n1 = glm::normalize(n1);
-				normal[ind0] += n0; // no need to /3 because it has not been normalized anyway
-				normal[ind1] += n0; // we will normalize it in the get_normal() call
-				normal[ind2] += n0;
-				normal[ind0] += n1;
-				normal[ind2] += n1;
-				normal[ind3] += n1;
-			} 
-		}
+void Cloth::set_adaptive(bool on, int min_steps) {
+	adaptive = on;
+	min_substep = glm::max(1, min_steps);
+}
+
+int Cloth::substeps_used() const {
+	return last_substep;
+}
+
+glm::vec3 Cloth::obs_at(glm::vec3 from, glm::vec3 to, int step, int substep) {
+	return from + (to - from) * (float(step) / substep);
+}
+
+void Cloth::collide(int ind, glm::vec3 start, glm::vec3 obs_from, glm::vec3 obs_to, float obs_rad, float dt) {
+	cloth_kernels::sweep_sphere<float>(pos[ind], vel[ind], start, obs_from, obs_to, obs_rad, dt);
+	if (!colliders.empty()) collide_meshes(pos[ind], vel[ind]);
+}
+
+// every triangle writes the drag on each of its vertices to its own slot of tforce, and every vertex then
+// adds up the slots of the triangles around it, so both loops run in parallel without sharing an entry
+void Cloth::drag(vector<glm::vec3>& gforce) {
+	cloth_kernels::grid_drag<float>(dims, pos.data(), vel.data(), tforce.data(), gforce.data(), active.data(),
+		[this](int q, glm::vec3& w0, glm::vec3& w1) { quad_wind(q, w0, w1); });
+}
+
+// drag on the two triangles of quad q, whose corners are at p and v in the order (i, j), (i, j + 1), (i + 1, j + 1), (i + 1, j)
+// the corners are passed by address, copying them into local arrays makes this loop twice as slow
+void Cloth::quad_drag(int q, const glm::vec3* const* p, const glm::vec3* const* v) {
+	glm::vec3 w0, w1;
+	quad_wind(q, w0, w1);
+	cloth_kernels::quad_drag<float>(p, v, w0, w1, tforce[2 * q], tforce[2 * q + 1]);
+}
+
+// air velocity over the two triangles of quad q
+void Cloth::quad_wind(int q, glm::vec3& w0, glm::vec3& w1) const {
+	w0 = wind_v;
+	w1 = wind_v;
+	if (!waves.empty()) { // turbulent wind
+		w0 += triangle_gust(2 * q);
+		w1 += triangle_gust(2 * q + 1);
 	}
 }
 
+// sum of the per-triangle values of the (up to six) triangles around vertex (i, j), always in the same order
+glm::vec3 Cloth::gather_triangles(const vector<glm::vec3>& t, int i, int j) const {
+	return cloth_kernels::gather_triangles<float>(dims, t.data(), i, j);
+}
+
 void Cloth::set_wind(glm::vec3 new_speed) {
+	if (sleeping && new_speed != wind_v) wake_all();
 	wind_v = new_speed;
+	wind_speed = glm::length(new_speed);
+}
+
+void Cloth::set_storage(storage s) {
+	layout = s;
+}
+
+void Cloth::set_integrator(integrator m) {
+	method = m;
+	if (sleeping) wake_all(); // only the explicit solver looks after the sleeping tiles
 }
\ No newline at end of file
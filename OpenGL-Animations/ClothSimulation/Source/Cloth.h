@@ -8,11 +8,19 @@
 
 #include <vector>
 
+#include "../../Tools/SIMD.h"
+#include "ClothKernels.h"
+#include "MeshBVH.h"
+
 using namespace std;
 
 class Cloth {
 
 public:
+	enum class storage { aos, soa }; // memory layout used by the explicit solver
+	enum class integrator { explicit_euler, implicit_euler, xpbd }; // time integration scheme
+	enum class xpbd_solve { jacobi, gauss_seidel }; // how the XPBD constraints are iterated
+
 	int length, width;
 	vector<glm::vec3> pos; // position of every conjunction
 
@@ -20,21 +28,272 @@ public:
 
 	Cloth(int length, int width, float gravity, float restlen, float mass, float k, float kv);
 
-	void update(float dt, int substep, glm::vec3 obs_loc, float obs_rad);
+	void update(float dt, int substep, glm::vec3 obs_loc, float obs_rad); // in adaptive mode substep is the most it may use
 
 	vector<float> vertex_buffer(); // return the positions of each vertex in vbo format
 	vector<float> get_normal(); // returns the normals of each vertex
-	vector<int> get_index(); // return the index buffer of the cloth
+	vector<int> get_index(); // return the index buffer of the render mesh
+	vector<float> get_uv(); // return the texture coordinates of each vertex of the render mesh
+	int render_floats() const; // floats written by write_render(), 6 per vertex of the render mesh
+	void write_render(float* out) const; // interleaved position & unit normal of each render vertex into out, allocates nothing
+	void set_refinement(int r); // render r x r smooth quads for every simulated one, 1 renders the grid itself
+	int render_length() const; // vertices of the render mesh along each side
+	int render_width() const;
+
+	void set_wind(glm::vec3 new_speed); // set the wind velocity
+	void set_turbulence(float intensity, float scale, float frequency, int interval); // gusts of size scale with an RMS speed of intensity times the wind speed, sampled every interval substeps, 0 turns them off
+	void set_storage(storage s); // choose between vec3 arrays and separate x/y/z arrays
+	void set_integrator(integrator m); // choose between explicit and implicit (backward) Euler
+	void set_adaptive(bool on, int min_substep); // pick the substep count every update from stability and motion
+	int substeps_used() const; // substeps taken by the last update
+	void set_cg(int max_iterations, float tolerance); // stopping criteria of the implicit solver
+	int cg_iterations() const; // conjugate gradient iterations spent in the last update (implicit only)
+	void set_xpbd(xpbd_solve s, int iterations); // XPBD iteration scheme and count, can be changed every frame
+	void set_strain_limit(float max_stretch, int iterations); // keep every string within (1 + max_stretch) restlen, 0 turns it off
+	void set_shear_bend(float k_shear, float k_bend); // stiffness of the diagonal and skip-one springs, 0 turns them off
+	int spring_count() const; // number of springs of every kind
+	int batch_count() const; // number of colour batches the springs are split into
+	void set_self_collision(bool on, float thickness); // keep vertices at least thickness away from the other triangles
+	void self_collision_time(double& broadphase_ms, double& narrowphase_ms) const; // time spent in self-collision during the last update
+	int self_collision_pairs() const; // vertex-triangle pairs in the current candidate lists
+	int add_collider(const vector<float>& triangles, float thickness); // triangle mesh obstacle in loadobj() format, returns its id
+	// place a static or kinematic collider, call it between updates, the next update spreads the move over its frame
+	void move_collider(int id, const glm::mat4& model);
+	void clear_colliders();
+	// two-way collision with particles (x/y/z arrays) that moved in a straight line from p0 to p, call it between updates, returns the contacts
+	int collide_particles(int count, const float* p0_x, const float* p0_y, const float* p0_z, float* p_x, float* p_y, float* p_z,
+		float* p_vx, float* p_vy, float* p_vz, float p_mass, float thickness);
+	void set_pinned(int i, int j, bool pinned); // pin vertex (i, j) where it is, or let it go; (0, 0), (length / 3, 0), (2 length / 3, 0) and (length - 1, 0) start pinned
+	void set_vertex_mass(int i, int j, float m); // e.g. a heavier hem, every vertex starts with the mass of the cloth
+	int add_attachment(int i, int j); // pin vertex (i, j) to a target that can move, returns its id, or -1 outside the cloth
+	void move_attachment(int id, glm::vec3 target); // the vertex gets there by the end of the next update
+	void clear_pins(); // let every pinned and attached vertex go
+	void set_sleeping(bool on, float energy, float force, int frames); // skip tiles that stayed still for frames updates (explicit solver)
+	float active_fraction() const; // share of tiles simulated in the last update, 1 unless sleeping
 
 private:
+	cloth_kernels::grid dims; // length and width for the kernels
 	float gravity;
 	float restlen, mass;
 	float k, kv;
+	float k_shear, k_bend; // stiffness of the shear and bending springs (0 if absent)
 	glm::vec3 wind_v;
+	float wind_speed; // length of wind_v, the gusts grow with it
+	storage layout;
+	integrator method;
+	glm::vec3 obs_prev; // sphere position passed to the last update, the sphere is swept from there
+	bool obs_known; // false before the first update
+	bool adaptive; // choose the substep count in update()
+	int min_substep, last_substep;
+	vector<float> row_speed; // fastest vertex of every row, for the adaptive substep count
 
 	vector<glm::vec3> vel; // velocity of every conjunction
-	vector<glm::vec3> normal; // (unnormalized) normal of every conjunction
+
+	// vertex normals, computed from pos only when get_normal() or write_render() ask for them
+	mutable simd::aligned_floats nx, ny, nz; // unit normal of every conjunction, padded to whole SIMD registers
+	mutable vector<glm::vec3> tri_normal; // unit normal of every triangle
+	mutable bool normals_valid; // false once pos changed
+
+	// per-string and per-vertex force buffers, allocated once in init()
+	vector<glm::vec3> vforce; // forces in the vertical strings, length * (width - 1)
+	vector<glm::vec3> hforce; // forces in the horizontal strings, (length - 1) * width
+	vector<glm::vec3> gforce; // drag force on each vertex
+	vector<glm::vec3> tforce; // drag force per vertex of every triangle, 2 * (length - 1) * (width - 1)
+
+	// structure-of-arrays copies of the state, used when layout == storage::soa
+	// pos/vel are gathered into these at the start of update() and written back at the end
+	simd::aligned_floats px, py, pz; // positions
+	simd::aligned_floats vx, vy, vz; // velocities
+	simd::aligned_floats vfx, vfy, vfz; // vertical string forces, length * (width + 1) with a zero at both ends of each row
+	simd::aligned_floats hfx, hfy, hfz; // horizontal string forces, (length + 1) * width with a zero row at both ends
+	simd::aligned_floats gfx, gfy, gfz; // drag force on each vertex
+
+	// pins and masses (ClothPins.cpp)
+	struct attachment {
+		int vertex; // -1 once the vertex was let go
+		glm::vec3 from, to; // where the vertex is at the start and at the end of the update
+	};
+	vector<float> vertex_mass; // mass of every vertex, kept for pinned ones too
+	simd::aligned_floats inv_mass; // 1 / vertex_mass, 0 for pinned vertices
+	simd::aligned_floats free_mask; // 0 for pinned vertices, 1 for the rest
+	float min_mass; // the lightest vertex sets the stability limit
+	vector<int> pins; // every pinned vertex, attached ones included
+	vector<int> tether; // nearest pin of every vertex on the rest grid, for the strain limit (ClothStrain.cpp)
+	vector<float> tether_len; // rest distance to that pin
+	bool tethers_valid; // false once pins changed
+	vector<attachment> attachments;
+
+	// implicit solver data (ClothImplicit.cpp)
+	int cg_max_iter;
+	float cg_tol;
+	int cg_iter_used;
+	vector<glm::vec3> vdir, hdir; // unit direction of every string
+	vector<float> vcoef, hcoef; // max(0, 1 - restlen / len) of every string
+	vector<glm::vec3> vprod, hprod; // per-string terms of a matrix-vector product
+	vector<glm::vec3> cg_b, cg_r, cg_z, cg_d, cg_q, cg_dv, cg_diag; // conjugate gradient vectors
+	vector<glm::vec3> cg_n; // normal of the sphere at every vertex it holds in this substep, zero for the rest
+	vector<unsigned char> cg_release; // vertices the sphere held back in the last substep, left free in this one
+	vector<double> cg_row; // per-row partial sums of the dot products, so they do not depend on the threads
+
+	// every spring, structural ones first (ClothSprings.cpp)
+	struct spring {
+		int a, b; // the two conjunctions
+		float rest; // rest length
+		float k, kv; // stiffness and damping
+	};
+	vector<spring> springs; // stored batch by batch
+	vector<int> batch_start; // springs of batch c are [batch_start[c], batch_start[c + 1]), none of them share a vertex
+	int extra_batch; // first batch of shear and bending springs
+	vector<int> adj_start, adj_spring; // springs attached to each vertex, in compressed rows
+	vector<glm::vec3> sforce; // net force of the shear and bending springs on each vertex
+	vector<glm::vec3> sdir; // unit direction of every spring (implicit solver)
+	vector<float> scoef; // max(0, 1 - rest / len) of every spring (implicit solver)
+
+	// strain limiting (ClothStrain.cpp)
+	float strain_limit; // largest stretch of a string relative to its rest length, 0 for none
+	int strain_iter; // passes over the strings per substep
+
+	// XPBD data (ClothXPBD.cpp)
+	vector<float> lambda; // XPBD multiplier of every spring
+	vector<glm::vec3> spring_dx; // Jacobi correction of every spring
+	vector<glm::vec3> prev_pos; // positions at the start of the substep
+	xpbd_solve xpbd_mode;
+	int xpbd_iter;
+
+	// self-collision and particle collision data (ClothCollision.cpp)
+	bool self_collision;
+	float sc_thickness; // minimum distance between a vertex and a triangle
+	float sc_skin; // extra reach of the candidate lists, they are rebuilt once a vertex moves half of it
+	float sc_cell; // edge of a hash cell
+	unsigned cell_mask; // hash table size - 1
+	bool sc_valid; // false until the candidate lists are built for the current state
+	double sc_broad_ms, sc_narrow_ms; // timings of the last update
+	vector<int> tris; // three vertices per triangle
+	vector<unsigned> tri_cell; // hash cell of every triangle
+	vector<glm::vec3> tri_lo, tri_hi; // bounding box of every triangle, grown by thickness + skin
+	vector<int> cell_start, cell_tri; // triangles of each hash cell, in compressed rows
+	vector<int> cand_start, cand_tri; // candidate triangles of each vertex, in compressed rows
+	vector<signed char> cand_side; // side of the triangle each candidate vertex was on when the lists were built
+	vector<glm::vec3> build_pos; // positions when the candidate lists were built
+	vector<glm::vec3> sc_dp, sc_dv; // position and velocity corrections of every vertex
+	vector<int> pc_tri; // triangle every particle hit in the last particle collision, -1 for none
+	vector<glm::vec3> pc_bary, pc_impulse; // where on the triangle, and the impulse the particle took
+
+	// triangle mesh colliders (ClothCollision.cpp)
+	vector<MeshBVH> colliders;
+	vector<float> collider_thickness; // distance the cloth keeps from each collider
+	float collider_dt; // length of the update the colliders moved over
+
+	// render mesh refinement (ClothRefine.cpp)
+	struct refine_taps {
+		int index[4]; // grid rows (or columns) that shape a render vertex
+		float w[4], dw[4]; // their B-spline weights, and the derivative of them
+	};
+	int refine; // render quads along each side of a simulated quad
+	vector<refine_taps> refine_i, refine_j; // taps of every render row and column
+
+	// turbulent wind (ClothWind.cpp)
+	struct wind_wave {
+		glm::vec3 k; // wave vector
+		glm::vec3 amp; // velocity amplitude, perpendicular to k
+		float phase, omega; // phase at time 0 and angular frequency
+	};
+	vector<wind_wave> waves; // empty while the wind is uniform
+	int wind_interval; // substeps between two samples of the field
+	int wind_step; // substeps since the newer sample was taken, -1 before the first one
+	double wind_time; // time the field has run, in double as it only grows
+	glm::dvec3 wind_shift; // how far the mean wind has carried the gusts, likewise
+	float wind_blend; // weight of the newer sample in the current substep
+	simd::aligned_floats tcx, tcy, tcz; // triangle centres, padded to whole SIMD registers
+	simd::aligned_floats wax, way, waz; // gust at every triangle at the older sample
+	simd::aligned_floats wbx, wby, wbz; // ... and at the newer one
+
+	// sleeping tiles (ClothSleep.cpp)
+	static const int tile_size = 8; // vertices along each side of a tile, a multiple of simd::lanes
+	bool sleeping;
+	float sleep_energy, sleep_force; // a tile is still while its kinetic energy and largest net force stay below these
+	int sleep_frames; // updates a tile must be still before it sleeps
+	int tiles_l, tiles_w; // tiles along each side
+	int active_tiles; // tiles awake in the last update
+	vector<unsigned char> tile_awake;
+	vector<int> tile_quiet; // updates an awake tile has been still, -1 for a sleeping one that was disturbed
+	vector<glm::vec3> tile_box_lo, tile_box_hi; // bounding box of a sleeping tile
+	vector<unsigned char> active; // tile_awake of the tile of every vertex
+	vector<glm::vec3> frame_vel; // velocities at the start of the update
 
 	void init();
-	void drag(vector<glm::vec3> &dragforce, bool compute_normal); // compute drag force (and normals of each vertex along the way)
+	void update_aos(float dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad); // explicit solver on pos/vel
+	void spring_forces(); // compute the force in every string
+	glm::vec3 string_force(int a, int b, float ks, float kd, float rest) const; // force in the string from conjunction a to b
+	glm::vec3 gather(const vector<glm::vec3>& v, const vector<glm::vec3>& h, int i, int j) const; // net per-string value on vertex (i, j)
+	void collide(int ind, glm::vec3 start, glm::vec3 obs_from, glm::vec3 obs_to, float obs_rad, float dt); // resolve collision of a vertex that moved from start with the sphere and the meshes
+	int pick_substeps(float dt, int max_substep, glm::vec3 obs_from, glm::vec3 obs_loc); // adaptive substep count
+	static glm::vec3 obs_at(glm::vec3 from, glm::vec3 to, int step, int substep); // sphere position at the start of a substep
+	void drag(vector<glm::vec3> &dragforce); // compute drag force on every vertex
+	void quad_drag(int q, const glm::vec3* const* p, const glm::vec3* const* v); // drag of the two triangles of quad q into tforce
+	void quad_wind(int q, glm::vec3& w0, glm::vec3& w1) const; // air velocity over the two triangles of quad q
+	glm::vec3 gather_triangles(const vector<glm::vec3>& t, int i, int j) const; // net per-triangle value on vertex (i, j)
+	void update_normals() const; // recompute nx, ny, nz if they are stale
+
+	// pins and masses (ClothPins.cpp)
+	void init_pins();
+	void start_attached(); // the attached vertices start from where they are
+	void move_attached(int step, int substep, float total_dt, bool soa); // place the attached vertices after a substep
+
+	// implicit solver (ClothImplicit.cpp)
+	void init_implicit();
+	void update_implicit(float dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad);
+	void spring_jacobians(); // string directions and stiffness coefficients for the current positions
+	void apply_system(const vector<glm::vec3>& x, vector<glm::vec3>& y, float m, float c_damp, float c_stiff); // y = A x, with m times the mass matrix and c_damp, c_stiff times the damping and stiffness of every string
+	int solve_implicit(float c_damp, float c_stiff, int contacts); // filtered preconditioned conjugate gradient, returns the iteration count
+	int sphere_contacts(glm::vec3 obs0, glm::vec3 obs1, float obs_rad, float h); // constrain the vertices resting on the sphere, returns how many
+	double row_sum(int s) const; // total of partial sum s (0 or 1) of the rows, added in a fixed order
+
+	// springs (ClothSprings.cpp)
+	void init_springs();
+	spring make_spring(int a, int b, float ks, float kd) const;
+	float spring_damping(float ks) const; // damping of a shear or bending spring of stiffness ks
+	void add_batches(const vector<spring>& group); // colour a group of springs and append its batches
+	void spring_batch_forces(); // forces of the shear and bending springs into sforce
+
+	// strain limiting (ClothStrain.cpp)
+	void limit_strain(bool soa); // project the overstretched strings, on pos/vel or on the separate arrays
+	void find_tethers(); // nearest pin of every vertex, after the pin list changed
+	void limit_pin_distance(bool soa); // long range attachments: no vertex further from its nearest pin than allowed by the grid between them
+
+	// XPBD solver (ClothXPBD.cpp)
+	void update_xpbd(float dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad);
+	float spring_delta(int c, float h, glm::vec3& n) const; // multiplier update of one spring
+
+	// self-collision (ClothCollision.cpp)
+	void init_self_collision();
+	void hash_triangles(float reach); // rebuild the hash, with the triangle boxes grown by reach
+	void self_collision_broadphase(); // rebuild the hash and the candidate lists
+	void self_collide(); // push vertices out of nearby triangles, called at the end of every substep
+	void collide_meshes(glm::vec3& p, glm::vec3& v) const; // resolve collision of one vertex with the mesh colliders
+
+	// structure-of-arrays solver (ClothSoA.cpp)
+	void init_soa();
+	void update_soa(float dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad);
+	void spring_forces_soa();
+	void spring_batch_forces_soa(); // shear and bending springs, added to the drag arrays
+	void drag_soa();
+	void integrate_soa(float dt, glm::vec3 obs_from, glm::vec3 obs_to, float obs_rad);
+
+	// render mesh refinement (ClothRefine.cpp)
+	void refine_side(int n, vector<refine_taps>& taps) const;
+	void write_refined(float* out) const; // write_render() when refine > 1
+
+	// turbulent wind (ClothWind.cpp)
+	void init_wind();
+	void advance_wind(float dt, bool soa); // sample the field when due, called before the drag of every substep
+	void sample_wind(bool soa, double t, glm::dvec3 shift); // gusts at every triangle centre into wbx, wby, wbz
+	glm::vec3 triangle_gust(int t) const; // gust on triangle t in the current substep
+
+	// sleeping tiles (ClothSleep.cpp)
+	void init_sleep();
+	void wake_all();
+	void refresh_active(); // copy tile_awake to active
+	void wake_tiles(glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad); // before the substeps
+	void sleep_tiles(float dt, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad); // after the substeps
 };
\ No newline at end of file
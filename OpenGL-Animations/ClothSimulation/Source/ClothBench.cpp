@@ -0,0 +1,345 @@
+// Headless benchmark of the cloth solvers on the ClothSim scene
+// written by Yuxuan Huang
+
+#include "ClothBench.h"
+#include "Cloth.h"
+#include "ClothEnsemble.h"
+#include "GridCloth.h"
+#include "MeshCloth.h"
+#include "../../ParticleSystems/Source/ParticleSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+	const float frame_dt = 0.035f; // same frame step as ClothSim.cpp
+
+	// a solver configuration to time
+	struct bench_case {
+		const char* name;
+		Cloth::integrator method;
+		Cloth::storage layout;
+		int substep;
+		Cloth::xpbd_solve xpbd_mode; // only used by the XPBD cases
+		int xpbd_iter;
+		bool self_collision;
+		bool mesh; // the sphere as a triangle mesh collider instead of the analytic one
+		int min_substep; // adaptive substeps between this and substep, 0 for a fixed count
+		bool kinematic; // the mesh sphere swings through the cloth and spins while it does
+	};
+
+	// mean string length relative to its rest length, how stretched the cloth looks
+	float mean_stretch(const Cloth& cloth, float restlen) {
+		double total = 0.0;
+		for (int i = 0; i < cloth.length; i++) {
+			for (int j = 0; j < cloth.width; j++) {
+				glm::vec3 p = cloth.pos[i * cloth.width + j];
+				if (j < cloth.width - 1) total += glm::length(cloth.pos[i * cloth.width + j + 1] - p) / restlen;
+				if (i < cloth.length - 1) total += glm::length(cloth.pos[(i + 1) * cloth.width + j] - p) / restlen;
+			}
+		}
+		return float(total / (cloth.length * (cloth.width - 1) + (cloth.length - 1) * cloth.width));
+	}
+
+	// largest string length relative to its rest length, to see whether the cloth stayed sane
+	float max_stretch(const Cloth& cloth, float restlen) {
+		float stretch = 0.0f;
+		for (int i = 0; i < cloth.length; i++) {
+			for (int j = 0; j < cloth.width; j++) {
+				glm::vec3 p = cloth.pos[i * cloth.width + j];
+				if (j < cloth.width - 1) stretch = glm::max(stretch, glm::length(cloth.pos[i * cloth.width + j + 1] - p) / restlen);
+				if (i < cloth.length - 1) stretch = glm::max(stretch, glm::length(cloth.pos[(i + 1) * cloth.width + j] - p) / restlen);
+			}
+		}
+		return stretch;
+	}
+
+	// the kinematic sphere at time t: back and forth along z through the cloth, spinning about its vertical axis
+	glm::mat4 swing(glm::vec3 center, float t) {
+		const float pi = 3.14159265f;
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), center + glm::vec3(0.0f, 0.0f, 2.0f * sin(2.0f * pi * t)));
+		model = glm::rotate(model, 3.0f * t, glm::vec3(0.0f, 1.0f, 0.0f));
+		return glm::translate(model, -center);
+	}
+
+	// triangles of a UV sphere in loadobj() format, wound counter-clockwise from outside
+	vector<float> sphere_mesh(glm::vec3 center, float radius, int rings, int segments) {
+		const float pi = 3.14159265f;
+		vector<float> tris;
+		for (int i = 0; i < rings; i++) {
+			for (int j = 0; j < segments; j++) {
+				glm::vec3 corner[4];
+				for (int c = 0; c < 4; c++) {
+					float theta = pi * (i + (c == 1 || c == 2)) / rings;
+					float phi = 2.0f * pi * (j + (c >= 2)) / segments;
+					corner[c] = center + radius * glm::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+				}
+				int order[6] = { 0, 1, 2, 0, 2, 3 };
+				for (int m : order) {
+					tris.push_back(corner[m].x);
+					tris.push_back(corner[m].y);
+					tris.push_back(corner[m].z);
+				}
+			}
+		}
+		return tris;
+	}
+
+	// the ClothSim grid as a triangle soup in loadobj() format, with the triangles in a scrambled order
+	// like an exported garment, where nothing says which vertices are neighbours
+	vector<float> grid_mesh(int size, float restlen) {
+		glm::vec3 upperleft((size - 1) * restlen / 2.0f, 0.0f, (size - 1) * restlen); // same corner as Cloth
+		vector<int> quads;
+		for (int q = 0; q < (size - 1) * (size - 1); q++) quads.push_back(q);
+		shuffle(quads.begin(), quads.end(), std::mt19937(1));
+		vector<float> tris;
+		for (int q : quads) {
+			int i = q / (size - 1), j = q % (size - 1);
+			int corner[6][2] = { { i, j }, { i, j + 1 }, { i + 1, j + 1 }, { i, j }, { i + 1, j + 1 }, { i + 1, j } };
+			for (int m = 0; m < 6; m++) {
+				tris.push_back(upperleft.x - corner[m][0] * restlen);
+				tris.push_back(upperleft.y + corner[m][1] * restlen);
+				tris.push_back(upperleft.z);
+			}
+		}
+		return tris;
+	}
+}
+
+void run_benchmark(int frames, int size) {
+	run_benchmark(frames, size, 0.0f, 0.0f);
+}
+
+void run_benchmark(int frames, int size, float k_shear, float k_bend) {
+	// the ClothSim scene, the sphere sits in the cloth's way so collisions are part of the cost
+	float restlen = 0.5f;
+	glm::vec3 sph_loc(0.0f, 10.0f, 10.0f);
+	float sph_rad = 2.5f;
+
+	bench_case cases[] = {
+		{ "explicit, vec3", Cloth::integrator::explicit_euler, Cloth::storage::aos, 70, Cloth::xpbd_solve::gauss_seidel, 0, false, false, 0, false },
+		{ "explicit, x/y/z", Cloth::integrator::explicit_euler, Cloth::storage::soa, 70, Cloth::xpbd_solve::gauss_seidel, 0, false, false, 0, false },
+		{ "implicit", Cloth::integrator::implicit_euler, Cloth::storage::aos, 1, Cloth::xpbd_solve::gauss_seidel, 0, false, false, 0, false },
+		{ "implicit", Cloth::integrator::implicit_euler, Cloth::storage::aos, 2, Cloth::xpbd_solve::gauss_seidel, 0, false, false, 0, false },
+		{ "implicit", Cloth::integrator::implicit_euler, Cloth::storage::aos, 4, Cloth::xpbd_solve::gauss_seidel, 0, false, false, 0, false },
+		{ "xpbd, gauss-seidel", Cloth::integrator::xpbd, Cloth::storage::aos, 5, Cloth::xpbd_solve::gauss_seidel, 10, false, false, 0, false },
+		{ "xpbd, jacobi", Cloth::integrator::xpbd, Cloth::storage::aos, 10, Cloth::xpbd_solve::jacobi, 20, false, false, 0, false },
+		{ "explicit, self", Cloth::integrator::explicit_euler, Cloth::storage::aos, 70, Cloth::xpbd_solve::gauss_seidel, 0, true, false, 0, false },
+		{ "xpbd gs, self", Cloth::integrator::xpbd, Cloth::storage::aos, 5, Cloth::xpbd_solve::gauss_seidel, 10, true, false, 0, false },
+		{ "explicit, mesh", Cloth::integrator::explicit_euler, Cloth::storage::aos, 70, Cloth::xpbd_solve::gauss_seidel, 0, false, true, 0, false },
+		{ "explicit, kinematic", Cloth::integrator::explicit_euler, Cloth::storage::aos, 70, Cloth::xpbd_solve::gauss_seidel, 0, false, true, 0, true },
+		{ "xpbd gs, mesh", Cloth::integrator::xpbd, Cloth::storage::aos, 5, Cloth::xpbd_solve::gauss_seidel, 10, false, true, 0, false },
+		{ "explicit, adaptive", Cloth::integrator::explicit_euler, Cloth::storage::soa, 70, Cloth::xpbd_solve::gauss_seidel, 0, false, false, 1, false },
+		{ "xpbd gs, adaptive", Cloth::integrator::xpbd, Cloth::storage::aos, 20, Cloth::xpbd_solve::gauss_seidel, 10, false, false, 2, false },
+	};
+
+	Cloth probe(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f);
+	probe.set_shear_bend(k_shear, k_bend);
+	printf("cloth benchmark: %dx%d grid, %d frames of %.3fs\n", size, size, frames, frame_dt);
+	printf("%d springs in %d batches (%.0f springs per batch)\n", probe.spring_count(), probe.batch_count(),
+		probe.spring_count() / float(probe.batch_count()));
+	printf("%-20s %8s %12s %10s %12s %10s %10s\n", "solver", "substep", "ms / frame", "cg iters", "peak stretch",
+		"broad ms", "narrow ms");
+	for (const bench_case& c : cases) {
+		Cloth cloth(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f);
+		cloth.set_integrator(c.method);
+		cloth.set_storage(c.layout);
+		cloth.set_xpbd(c.xpbd_mode, c.xpbd_iter);
+		if (k_shear > 0.0f || k_bend > 0.0f) cloth.set_shear_bend(k_shear, k_bend);
+		if (c.self_collision) cloth.set_self_collision(true, 0.2f * restlen);
+		if (c.min_substep > 0) cloth.set_adaptive(true, c.min_substep);
+		glm::vec3 obs_loc = sph_loc;
+		float obs_rad = sph_rad;
+		if (c.mesh) {
+			cloth.add_collider(sphere_mesh(sph_loc, sph_rad, 32, 64), 0.2f);
+			obs_loc = glm::vec3(0.0f, 0.0f, -1e4f); // analytic sphere out of the way
+			obs_rad = 0.0f;
+		}
+
+		// the stretch is checked after every frame, outside the timing, so a solver that blows up for a while and
+		// settles again still shows
+		int cg_total = 0, substep_total = 0;
+		double broad_total = 0.0, narrow_total = 0.0, update_ms = 0.0;
+		float stretch = 0.0f;
+		for (int f = 0; f < frames; f++) {
+			auto start = std::chrono::steady_clock::now();
+			if (c.kinematic) cloth.move_collider(0, swing(sph_loc, (f + 1) * frame_dt));
+			cloth.update(frame_dt, c.substep, obs_loc, obs_rad);
+			update_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			float now = max_stretch(cloth, restlen);
+			stretch = std::isfinite(now) ? glm::max(stretch, now) : now; // NaN sticks
+			cg_total += cloth.cg_iterations();
+			substep_total += cloth.substeps_used();
+			double broad, narrow;
+			cloth.self_collision_time(broad, narrow);
+			broad_total += broad;
+			narrow_total += narrow;
+		}
+
+		double ms = update_ms / frames;
+		printf("%-20s %8.1f %12.3f %10.1f %12.3f %10.3f %10.3f%s\n", c.name, substep_total / float(frames), ms, cg_total / float(frames), stretch,
+			broad_total / frames, narrow_total / frames, std::isfinite(stretch) ? "" : "  (unstable)");
+	}
+
+	// many cloths at once: one Cloth per cloth against a ClothEnsemble with a cloth per SIMD lane
+	const int ensemble_size = 16;
+	ClothEnsemble::instance inst = { -20.0f, restlen, 1.0f, 15000.0f, 800.0f, glm::vec3(0.0f) };
+	ClothEnsemble ensemble(size, size, vector<ClothEnsemble::instance>(ensemble_size, inst));
+	for (int c = 0; c < ensemble_size; c++) ensemble.set_obstacle(c, sph_loc, sph_rad);
+	vector<Cloth> separate(ensemble_size, Cloth(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f));
+	for (Cloth& cloth : separate) cloth.set_storage(Cloth::storage::soa);
+	auto ens_start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) {
+		for (Cloth& cloth : separate) cloth.update(frame_dt, 70, sph_loc, sph_rad);
+	}
+	double separate_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ens_start).count() / frames;
+	ens_start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) ensemble.update(frame_dt, 70);
+	double ensemble_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ens_start).count() / frames;
+	printf("%d explicit cloths: %.3f ms / frame as separate cloths, %.3f ms / frame as an ensemble\n", ensemble_size, separate_ms, ensemble_ms);
+
+	// the same grid as a general mesh cloth, in the order the triangles came in and reordered for locality
+	vector<float> grid = grid_mesh(size, restlen);
+	MeshCloth::ordering orders[] = { MeshCloth::ordering::input, MeshCloth::ordering::rcm, MeshCloth::ordering::morton };
+	const char* order_names[] = { "input", "rcm", "morton" };
+	for (int o = 0; o < 3; o++) {
+		MeshCloth mesh(grid, vector<float>(), -20.0f, 1.0f, 15000.0f, 800.0f, orders[o]);
+		glm::vec3 upperleft((size - 1) * restlen / 2.0f, 0.0f, (size - 1) * restlen);
+		int pins[4] = { 0, size / 3, 2 * size / 3, size - 1 }; // the pins of Cloth
+		for (int p : pins) mesh.set_pinned(mesh.closest_vertex(upperleft - glm::vec3(p * restlen, 0.0f, 0.0f)), true);
+		auto mesh_start = std::chrono::steady_clock::now();
+		for (int f = 0; f < frames; f++) mesh.update(frame_dt, 70, sph_loc, sph_rad);
+		double mesh_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mesh_start).count() / frames;
+		printf("mesh cloth, %-6s order: %d vertices, %d edges, bandwidth %d, %.3f ms / frame\n", order_names[o], mesh.vertex_count(),
+			mesh.edge_count(), mesh.bandwidth(), mesh_ms);
+	}
+
+	// sleeping only pays off once the cloth has settled, so let it hang for a while first
+	const int settle_frames = 1500;
+	Cloth settled(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f);
+	settled.set_storage(Cloth::storage::soa);
+	settled.set_sleeping(true, 1.0f, 10.0f, 20);
+	for (int f = 0; f < settle_frames; f++) settled.update(frame_dt, 70, sph_loc, sph_rad);
+	Cloth awake = settled;
+	awake.set_sleeping(false, 0.0f, 0.0f, 1);
+	float awake_total = 0.0f;
+	auto sleep_start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) {
+		settled.update(frame_dt, 70, sph_loc, sph_rad);
+		awake_total += settled.active_fraction();
+	}
+	double sleeping_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sleep_start).count() / frames;
+	sleep_start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) awake.update(frame_dt, 70, sph_loc, sph_rad);
+	double awake_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sleep_start).count() / frames;
+	printf("settled cloth: %.3f ms / frame with sleeping tiles (%.0f%% awake), %.3f ms / frame without\n", sleeping_ms,
+		100.0f * awake_total / frames, awake_ms);
+
+	// the stiff cloth of ClothSim against a soft one that strain limiting keeps from stretching, adaptive substeps
+	// the damping keeps its ratio to the stiffness
+	float strain_k[2] = { 15000.0f, 1000.0f };
+	for (int c = 0; c < 2; c++) {
+		Cloth strained(size, size, -20.0f, restlen, 1.0f, strain_k[c], 800.0f * sqrt(strain_k[c] / 15000.0f));
+		strained.set_storage(Cloth::storage::soa);
+		strained.set_adaptive(true, 1);
+		if (c == 1) strained.set_strain_limit(0.05f, 2);
+		int strain_substeps = 0;
+		auto strain_start = std::chrono::steady_clock::now();
+		for (int f = 0; f < frames; f++) {
+			strained.update(frame_dt, 70, sph_loc, sph_rad);
+			strain_substeps += strained.substeps_used();
+		}
+		double strain_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - strain_start).count() / frames;
+		printf("k %5.0f, %s: %.1f substeps, %.3f ms / frame, mean stretch %.3f, max stretch %.3f\n", strain_k[c],
+			c == 1 ? "5% strain limit" : "no strain limit", strain_substeps / float(frames), strain_ms, mean_stretch(strained, restlen),
+			max_stretch(strained, restlen));
+	}
+
+	// turbulent wind, with the field sampled every substep and every 8 substeps
+	double wind_ms[3];
+	int wind_interval[3] = { 0, 1, 8 };
+	for (int c = 0; c < 3; c++) {
+		Cloth windy(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f);
+		windy.set_storage(Cloth::storage::soa);
+		windy.set_wind(glm::vec3(0.0f, -8.0f, 0.0f));
+		windy.set_turbulence(wind_interval[c] ? 0.4f : 0.0f, 5.0f, 0.5f, wind_interval[c]);
+		auto wind_start = std::chrono::steady_clock::now();
+		for (int f = 0; f < frames; f++) windy.update(frame_dt, 70, sph_loc, sph_rad);
+		wind_ms[c] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wind_start).count() / frames;
+	}
+	printf("gusty wind: %.3f ms / frame uniform, %.3f ms sampled every substep, %.3f ms every 8 substeps\n", wind_ms[0], wind_ms[1], wind_ms[2]);
+
+	// the templated cloth in float and in double, the double one is the reference for the explicit kernels
+	// a few frames in, Cloth and GridCloth<float> must be within rounding of it; later the folds around the
+	// sphere amplify any rounding difference, so a longer comparison would not tell a bug from chaos
+	const int check_frames = 5;
+	const double tolerance = 1e-3 * restlen;
+	Cloth checked(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f);
+	GridCloth<float> grid_float(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f);
+	GridCloth<double> grid_double(size, size, -20.0, restlen, 1.0, 15000.0, 800.0);
+	glm::dvec3 sph_loc_d(sph_loc.x, sph_loc.y, sph_loc.z);
+	for (int f = 0; f < check_frames; f++) {
+		checked.update(frame_dt, 70, sph_loc, sph_rad);
+		grid_float.update(frame_dt, 70, sph_loc, sph_rad);
+		grid_double.update(frame_dt, 70, sph_loc_d, sph_rad);
+	}
+	double cloth_err = 0.0, grid_err = 0.0;
+	for (int v = 0; v < size * size; v++) {
+		glm::dvec3 pc(checked.pos[v].x, checked.pos[v].y, checked.pos[v].z);
+		glm::dvec3 pg(grid_float.pos[v].x, grid_float.pos[v].y, grid_float.pos[v].z);
+		cloth_err = glm::max(cloth_err, glm::length(pc - grid_double.pos[v]));
+		grid_err = glm::max(grid_err, glm::length(pg - grid_double.pos[v]));
+	}
+	printf("float against double after %d frames: Cloth %.2e, GridCloth %.2e, tolerance %.2e, %s\n", check_frames, cloth_err, grid_err,
+		tolerance, cloth_err <= tolerance && grid_err <= tolerance ? "pass" : "FAIL");
+
+	auto grid_start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) grid_float.update(frame_dt, 70, sph_loc, sph_rad);
+	double float_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - grid_start).count() / frames;
+	grid_start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) grid_double.update(frame_dt, 70, sph_loc_d, sph_rad);
+	double double_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - grid_start).count() / frames;
+	printf("templated cloth: %.3f ms / frame in float, %.3f ms in double\n", float_ms, double_ms);
+
+	// the demo's hose at twice the rate, only the collision of the particles with the cloth is timed
+	Cloth soaked(size, size, -20.0f, restlen, 1.0f, 15000.0f, 800.0f);
+	soaked.set_storage(Cloth::storage::soa);
+	ParticleSystem hose(10000, 2.0f, 0.0f, 30000, glm::vec3(3.0f, 12.0f, 7.0f), 0.5f, src_type::dim2, axis::Y, -15.0f, 5.0f, glm::vec3(1.0f));
+	double hose_ms = 0.0;
+	int contacts = 0, particles = 0;
+	for (int f = 0; f < frames; f++) {
+		soaked.update(frame_dt, 70, sph_loc, sph_rad);
+		hose.update(frame_dt, ParticleSystem::particle_type::fluid, sph_loc, sph_rad);
+		auto hose_start = std::chrono::steady_clock::now();
+		contacts += soaked.collide_particles(hose.count(), hose.start_array(axis::X), hose.start_array(axis::Y), hose.start_array(axis::Z),
+			hose.pos_array(axis::X), hose.pos_array(axis::Y), hose.pos_array(axis::Z),
+			hose.vel_array(axis::X), hose.vel_array(axis::Y), hose.vel_array(axis::Z), 0.01f, 0.05f);
+		hose_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - hose_start).count();
+		particles += hose.count();
+	}
+	printf("water on cloth: %.0f particles, %.0f contacts, %.3f ms / frame for the collision\n", particles / float(frames),
+		contacts / float(frames), hose_ms / frames);
+
+	// render export: the vector copies ClothSim used to make every frame against one pass into a buffer
+	probe.update(frame_dt, 1, sph_loc, sph_rad); // so there are normals
+	vector<float> target(probe.render_floats());
+	volatile float sink = 0.0f; // keeps the copies from being optimized away
+	auto start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) {
+		vector<float> v = probe.vertex_buffer();
+		vector<float> n = probe.get_normal();
+		sink = sink + v[0] + n[0];
+	}
+	double copy_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++) {
+		probe.write_render(target.data());
+		sink = sink + target[0];
+	}
+	double write_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	printf("render export: %.3f ms with vertex_buffer() + get_normal(), %.3f ms with write_render()\n", copy_ms, write_ms);
+}
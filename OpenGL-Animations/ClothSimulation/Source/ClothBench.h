@@ -0,0 +1,8 @@
+// Headless benchmark of the cloth solvers on the ClothSim scene
+// written by Yuxuan Huang
+
+// runs every solver configuration for the given number of frames and prints the wall time per frame
+void run_benchmark(int frames, int size);
+
+// same, with shear and bending springs of the given stiffness
+void run_benchmark(int frames, int size, float k_shear, float k_bend);
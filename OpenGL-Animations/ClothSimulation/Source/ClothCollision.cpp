@@ -0,0 +1,404 @@
+// Collision of the string-based cloth with itself, with triangle meshes and with particles
+// self-collision: vertices are kept a small distance away from the triangles of the cloth
+// broadphase: triangles are put in a uniform spatial hash, and every vertex keeps a list of the
+// triangles near it, padded by a skin margin so the lists survive several substeps
+// narrowphase: every substep, each vertex is tested against its own list only
+// particles: the same hash is rebuilt once per step, and every particle near the cloth walks the cells
+// along its path, so the cost grows with the particles that get close and not with particles x triangles
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+#include <chrono>
+
+namespace {
+
+	inline unsigned hash_cell(int x, int y, int z, unsigned mask) {
+		return (unsigned(x) * 73856093u ^ unsigned(y) * 19349663u ^ unsigned(z) * 83492791u) & mask;
+	}
+
+	inline int cell_of(float v, float cell) {
+		return int(floor(v / cell));
+	}
+
+	double ms_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void Cloth::init_self_collision() {
+	self_collision = false;
+	sc_thickness = 0.2f * restlen;
+	sc_skin = 0.5f * restlen;
+	sc_broad_ms = 0.0;
+	sc_narrow_ms = 0.0;
+
+	// same triangles as the index buffer
+	tris.clear();
+	for (int i = 0; i < length - 1; i++) {
+		for (int j = 0; j < width - 1; j++) {
+			int t[6] = { i * width + j, i * width + 1 + j, (i + 1) * width + 1 + j,
+				i * width + j, (i + 1) * width + 1 + j, (i + 1) * width + j };
+			tris.insert(tris.end(), t, t + 6);
+		}
+	}
+
+	int n = length * width;
+	int ntri = tris.size() / 3;
+	tri_cell.assign(ntri, 0);
+	tri_lo.assign(ntri, glm::vec3(0.0f));
+	tri_hi.assign(ntri, glm::vec3(0.0f));
+	cand_start.assign(n + 1, 0);
+	cand_tri.clear();
+	cand_side.clear();
+	build_pos.assign(n, glm::vec3(0.0f));
+	sc_dp.assign(n, glm::vec3(0.0f));
+	sc_dv.assign(n, glm::vec3(0.0f));
+	sc_valid = false;
+}
+
+void Cloth::set_self_collision(bool on, float thickness) {
+	self_collision = on;
+	sc_thickness = thickness;
+	sc_skin = glm::max(thickness, 0.5f * restlen);
+	sc_valid = false;
+}
+
+void Cloth::self_collision_time(double& broadphase_ms, double& narrowphase_ms) const {
+	broadphase_ms = sc_broad_ms;
+	narrowphase_ms = sc_narrow_ms;
+}
+
+int Cloth::self_collision_pairs() const {
+	return cand_tri.size();
+}
+
+// put every triangle in the hash, cells are large enough that the triangles within reach of a point
+// are all in the 27 cells around it
+void Cloth::hash_triangles(float reach) {
+	int ntri = tris.size() / 3;
+
+	// triangle boxes are grown by the reach once here instead of for every test
+	vector<float> radius(ntri);
+	#pragma omp parallel for
+	for (int t = 0; t < ntri; t++) {
+		glm::vec3 a = pos[tris[3 * t]], b = pos[tris[3 * t + 1]], c = pos[tris[3 * t + 2]];
+		glm::vec3 mid = (a + b + c) / 3.0f;
+		radius[t] = glm::max(glm::max(glm::length(a - mid), glm::length(b - mid)), glm::length(c - mid));
+		tri_lo[t] = glm::min(glm::min(a, b), c) - glm::vec3(reach);
+		tri_hi[t] = glm::max(glm::max(a, b), c) + glm::vec3(reach);
+	}
+	float tri_radius = 0.0f;
+	for (int t = 0; t < ntri; t++) tri_radius = glm::max(tri_radius, radius[t]);
+	sc_cell = tri_radius + reach;
+
+	// hash every triangle by its centroid, then counting sort them into the table
+	unsigned size = 1;
+	while (size < 2 * unsigned(ntri)) size <<= 1;
+	unsigned mask = size - 1;
+	#pragma omp parallel for
+	for (int t = 0; t < ntri; t++) {
+		glm::vec3 c = (pos[tris[3 * t]] + pos[tris[3 * t + 1]] + pos[tris[3 * t + 2]]) / 3.0f;
+		tri_cell[t] = hash_cell(cell_of(c.x, sc_cell), cell_of(c.y, sc_cell), cell_of(c.z, sc_cell), mask);
+	}
+	cell_start.assign(size + 1, 0);
+	for (int t = 0; t < ntri; t++) cell_start[tri_cell[t] + 1]++;
+	for (unsigned c = 0; c < size; c++) cell_start[c + 1] += cell_start[c];
+	cell_tri.resize(ntri);
+	vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+	for (int t = 0; t < ntri; t++) cell_tri[fill[tri_cell[t]]++] = t;
+	cell_mask = mask;
+}
+
+// rebuild the hash and every vertex's candidate list
+void Cloth::self_collision_broadphase() {
+	int n = length * width;
+	hash_triangles(sc_thickness + sc_skin);
+	unsigned mask = cell_mask;
+
+	// candidate lists in two passes, count then fill, each vertex writing its own range
+	for (int pass = 0; pass < 2; pass++) {
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++) {
+			glm::vec3 p = pos[i];
+			int ci = i / width, cj = i % width;
+			int cx = cell_of(p.x, sc_cell), cy = cell_of(p.y, sc_cell), cz = cell_of(p.z, sc_cell);
+			int count = 0;
+			int out = pass == 0 ? 0 : cand_start[i];
+			for (int dx = -1; dx <= 1; dx++) for (int dy = -1; dy <= 1; dy++) for (int dz = -1; dz <= 1; dz++) {
+				unsigned h = hash_cell(cx + dx, cy + dy, cz + dz, mask);
+				for (int e = cell_start[h]; e < cell_start[h + 1]; e++) {
+					int t = cell_tri[e];
+					const glm::vec3& lo = tri_lo[t];
+					const glm::vec3& hi = tri_hi[t];
+					if (p.x < lo.x || p.y < lo.y || p.z < lo.z || p.x > hi.x || p.y > hi.y || p.z > hi.z) continue;
+
+					// skip the triangles around the vertex itself, they are always close
+					const int* v = &tris[3 * t];
+					bool near = false;
+					for (int m = 0; m < 3; m++) {
+						if (abs(v[m] / width - ci) <= 1 && abs(v[m] % width - cj) <= 1) near = true;
+					}
+					if (near) continue;
+
+					if (pass == 1) {
+						// remember which side the vertex is on while the cloth is still untangled
+						glm::vec3 nrm = glm::cross(pos[v[1]] - pos[v[0]], pos[v[2]] - pos[v[0]]);
+						cand_tri[out + count] = t;
+						cand_side[out + count] = glm::dot(p - pos[v[0]], nrm) >= 0.0f ? 1 : -1;
+					}
+					count++;
+				}
+			}
+			if (pass == 0) cand_start[i + 1] = count;
+		}
+
+		if (pass == 0) {
+			cand_start[0] = 0;
+			for (int i = 0; i < n; i++) cand_start[i + 1] += cand_start[i];
+			cand_tri.resize(cand_start[n]);
+			cand_side.resize(cand_start[n]);
+		}
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) build_pos[i] = pos[i];
+	sc_valid = true;
+}
+
+// keep every vertex at least sc_thickness away from the triangles in its list
+// corrections are computed against the current state first and applied afterwards, so no thread
+// reads a vertex while another one moves it
+void Cloth::self_collide() {
+	if (!self_collision) return;
+	int n = length * width;
+
+	// the lists hold as long as nothing moved more than half the skin since they were built
+	auto start = std::chrono::steady_clock::now();
+	int moved = 0;
+	float limit = 0.25f * sc_skin * sc_skin;
+	#pragma omp parallel for reduction(+:moved)
+	for (int i = 0; i < n; i++) {
+		glm::vec3 d = pos[i] - build_pos[i];
+		if (glm::dot(d, d) > limit) moved++;
+	}
+	if (!sc_valid || moved > 0) self_collision_broadphase();
+	sc_broad_ms += ms_since(start);
+
+	start = std::chrono::steady_clock::now();
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		glm::vec3 dp(0.0f), dv(0.0f);
+		if (free_mask[i] != 0.0f) {
+			for (int e = cand_start[i]; e < cand_start[i + 1]; e++) {
+				const int* v = &tris[3 * cand_tri[e]];
+				glm::vec3 p = pos[i] + dp;
+				glm::vec3 a = pos[v[0]], b = pos[v[1]], c = pos[v[2]];
+				glm::vec3 nrm = glm::cross(b - a, c - a);
+				float area2 = glm::length(nrm);
+				if (area2 < 1e-12f) continue;
+				nrm = (cand_side[e] / area2) * nrm; // unit normal pointing to the vertex's side
+
+				float dist = glm::dot(p - a, nrm);
+				if (dist >= sc_thickness) continue;
+
+				// barycentric coordinates of the projection, the vertex must be over the triangle
+				glm::vec3 q = p - dist * nrm;
+				float wa = glm::dot(glm::cross(b - q, c - q), nrm) * cand_side[e] / area2;
+				float wb = glm::dot(glm::cross(c - q, a - q), nrm) * cand_side[e] / area2;
+				if (wa < 0.0f || wb < 0.0f || wa + wb > 1.0f) continue;
+
+				dp += (sc_thickness - dist) * nrm;
+				glm::vec3 vtri = wa * vel[v[0]] + wb * vel[v[1]] + (1.0f - wa - wb) * vel[v[2]];
+				float vn = glm::dot(vel[i] + dv - vtri, nrm);
+				if (vn < 0.0f) dv -= vn * nrm; // stop moving into the triangle
+			}
+		}
+		sc_dp[i] = dp;
+		sc_dv[i] = dv;
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		pos[i] += sc_dp[i];
+		vel[i] += sc_dv[i];
+	}
+	sc_narrow_ms += ms_since(start);
+}
+
+int Cloth::add_collider(const vector<float>& triangles, float thickness) {
+	colliders.push_back(MeshBVH(triangles));
+	collider_thickness.push_back(thickness);
+	if (sleeping) wake_all();
+	return colliders.size() - 1;
+}
+
+void Cloth::move_collider(int id, const glm::mat4& model) {
+	colliders[id].set_transform(model);
+	if (sleeping) wake_all(); // the tiles do not know where the meshes are
+}
+
+void Cloth::clear_colliders() {
+	colliders.clear();
+	collider_thickness.clear();
+	if (sleeping) wake_all();
+}
+
+// only reads the trees, so every vertex can be resolved in parallel
+void Cloth::collide_meshes(glm::vec3& p, glm::vec3& v) const {
+	for (int c = 0; c < colliders.size(); c++) {
+		// a mesh that moved this frame is searched farther out, for the vertices its faces swept over
+		float thickness = collider_thickness[c];
+		glm::vec3 q, n, moved;
+		if (!colliders[c].closest(p, thickness + colliders[c].motion(), q, n, moved)) continue;
+
+		// outside, near an edge or a corner, push straight away from the closest point
+		// behind the face, the vertex went through it or the face went over it, so push along the face normal
+		glm::vec3 d = p - q;
+		float len = glm::length(d);
+		float side = glm::dot(d, n);
+		bool swept = side < 0.0f && glm::dot(p - (q - moved), n) > 0.0f; // in front of where the face was before the move
+		if (len > thickness && !swept) continue;
+		if (len > 1e-6f && side > 0.0f) n = d / len;
+		p = q + thickness * n;
+
+		// stop moving into the mesh relative to its surface, so a moving mesh carries the cloth along
+		glm::vec3 v_mesh = moved / collider_dt;
+		float vn = glm::dot(v - v_mesh, n);
+		if (vn < 0.0f) v -= vn * n;
+	}
+}
+
+// every particle moved in a straight line from its start to p during the step, and stops at the first triangle
+// it came within thickness of, on the side it came from; the start is passed in rather than taken as p - v dt,
+// since gravity and any bounce changed v after the move
+// the particles only change their own entries, the cloth keeps still until every contact is found,
+// and the impulses go to the vertices afterwards in particle order, so the result does not depend on the threads
+int Cloth::collide_particles(int count, const float* p0_x, const float* p0_y, const float* p0_z, float* p_x, float* p_y, float* p_z,
+	float* p_vx, float* p_vy, float* p_vz, float p_mass, float thickness) {
+	int n = length * width;
+	int np = count;
+	float reach = thickness + 0.5f * restlen; // also the step along the path of a particle
+	hash_triangles(reach);
+
+	// most of a spray never comes near the cloth
+	glm::vec3 lo = pos[0], hi = pos[0];
+	for (int i = 1; i < n; i++) {
+		lo = glm::min(lo, pos[i]);
+		hi = glm::max(hi, pos[i]);
+	}
+	lo -= glm::vec3(thickness);
+	hi += glm::vec3(thickness);
+
+	pc_tri.resize(np);
+	pc_bary.resize(np);
+	pc_impulse.resize(np);
+	#pragma omp parallel for
+	for (int p = 0; p < np; p++) {
+		pc_tri[p] = -1;
+		glm::vec3 p1(p_x[p], p_y[p], p_z[p]);
+		glm::vec3 pv(p_vx[p], p_vy[p], p_vz[p]);
+		glm::vec3 p0(p0_x[p], p0_y[p], p0_z[p]);
+		glm::vec3 plo = glm::min(p0, p1), phi = glm::max(p0, p1);
+		if (phi.x < lo.x || phi.y < lo.y || phi.z < lo.z || plo.x > hi.x || plo.y > hi.y || plo.z > hi.z) continue;
+
+		// every triangle it passes has its centroid within one cell of a cell on the path, so the cells of the
+		// path's box grown by one hold them all; each is visited once, a long path walks the cells around
+		// points every reach along it instead, should that be fewer
+		float first = 2.0f; // earliest contact along the path, in [0, 1]
+		int hit = -1;
+		glm::vec3 hit_pos, hit_n, hit_w;
+		auto test = [&](int t) {
+			const glm::vec3& tlo = tri_lo[t];
+			const glm::vec3& thi = tri_hi[t];
+			if (phi.x < tlo.x || phi.y < tlo.y || phi.z < tlo.z || plo.x > thi.x || plo.y > thi.y || plo.z > thi.z) return;
+
+			const int* v = &tris[3 * t];
+			glm::vec3 a = pos[v[0]], b = pos[v[1]], c = pos[v[2]];
+			glm::vec3 face = glm::cross(b - a, c - a);
+			float area2 = glm::length(face);
+			if (area2 < 1e-12f) return;
+			face /= area2;
+
+			// distances to the plane, positive on the side the particle came from
+			glm::vec3 nrm = face;
+			float d0 = glm::dot(p0 - a, nrm), d1 = glm::dot(p1 - a, nrm);
+			if (d0 < 0.0f) {
+				nrm = -nrm;
+				d0 = -d0;
+				d1 = -d1;
+			}
+			if (d1 >= thickness) return; // ends clear of it
+			float at = d0 > thickness ? (d0 - thickness) / (d0 - d1) : 0.0f;
+			if (at >= first) return;
+
+			// it must go through the triangle, or end over it if it stops short of the plane
+			// (the weights take the winding of the triangle, not the side it came from)
+			glm::vec3 x = p0 + (d1 < 0.0f ? d0 / (d0 - d1) : 1.0f) * (p1 - p0);
+			x -= glm::dot(x - a, face) * face;
+			float wa = glm::dot(glm::cross(b - x, c - x), face) / area2;
+			float wb = glm::dot(glm::cross(c - x, a - x), face) / area2;
+			if (wa < 0.0f || wb < 0.0f || wa + wb > 1.0f) return;
+
+			first = at;
+			hit = t;
+			hit_pos = x;
+			hit_n = nrm;
+			hit_w = glm::vec3(wa, wb, 1.0f - wa - wb);
+		};
+		int x0 = cell_of(plo.x, sc_cell) - 1, y0 = cell_of(plo.y, sc_cell) - 1, z0 = cell_of(plo.z, sc_cell) - 1;
+		int x1 = cell_of(phi.x, sc_cell) + 1, y1 = cell_of(phi.y, sc_cell) + 1, z1 = cell_of(phi.z, sc_cell) + 1;
+		int steps = int(glm::length(p1 - p0) / reach) + 1;
+		if ((x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1) <= 27 * (steps + 1)) {
+			for (int cx = x0; cx <= x1; cx++) for (int cy = y0; cy <= y1; cy++) for (int cz = z0; cz <= z1; cz++) {
+				unsigned h = hash_cell(cx, cy, cz, cell_mask);
+				for (int e = cell_start[h]; e < cell_start[h + 1]; e++) test(cell_tri[e]);
+			}
+		}
+		else {
+			for (int s = 0; s <= steps; s++) {
+				glm::vec3 q = p0 + (p1 - p0) * (float(s) / steps);
+				int cx = cell_of(q.x, sc_cell), cy = cell_of(q.y, sc_cell), cz = cell_of(q.z, sc_cell);
+				for (int dx = -1; dx <= 1; dx++) for (int dy = -1; dy <= 1; dy++) for (int dz = -1; dz <= 1; dz++) {
+					unsigned h = hash_cell(cx + dx, cy + dy, cz + dz, cell_mask);
+					for (int e = cell_start[h]; e < cell_start[h + 1]; e++) test(cell_tri[e]);
+				}
+			}
+		}
+		if (hit < 0) continue;
+
+		// the particle rests on the cloth and loses the velocity it had into it, relative to the triangle,
+		// which takes the opposite impulse spread over its corners; water does not bounce off cloth
+		const int* v = &tris[3 * hit];
+		glm::vec3 vtri = hit_w.x * vel[v[0]] + hit_w.y * vel[v[1]] + hit_w.z * vel[v[2]];
+		float vn = glm::dot(pv - vtri, hit_n);
+		glm::vec3 impulse(0.0f);
+		if (vn < 0.0f) {
+			float w_tri = hit_w.x * hit_w.x * inv_mass[v[0]] + hit_w.y * hit_w.y * inv_mass[v[1]] + hit_w.z * hit_w.z * inv_mass[v[2]];
+			impulse = (-vn / (1.0f / p_mass + w_tri)) * hit_n;
+			pv += impulse / p_mass;
+			p_vx[p] = pv.x;
+			p_vy[p] = pv.y;
+			p_vz[p] = pv.z;
+		}
+		p1 = hit_pos + thickness * hit_n;
+		p_x[p] = p1.x;
+		p_y[p] = p1.y;
+		p_z[p] = p1.z;
+		pc_tri[p] = hit;
+		pc_bary[p] = hit_w;
+		pc_impulse[p] = impulse;
+	}
+
+	int contacts = 0;
+	for (int p = 0; p < np; p++) {
+		if (pc_tri[p] < 0) continue;
+		contacts++;
+		const int* v = &tris[3 * pc_tri[p]];
+		vel[v[0]] -= (pc_bary[p].x * inv_mass[v[0]]) * pc_impulse[p];
+		vel[v[1]] -= (pc_bary[p].y * inv_mass[v[1]]) * pc_impulse[p];
+		vel[v[2]] -= (pc_bary[p].z * inv_mass[v[2]]) * pc_impulse[p];
+	}
+	if (contacts > 0 && sleeping) wake_all(); // the tiles do not know where the particles are
+	return contacts;
+}
@@ -0,0 +1,307 @@
+// Many same-sized string-based cloths simulated together, one cloth per SIMD lane
+// the stages follow the explicit solver of Cloth step by step, with every float replaced by a
+// register holding the same value of simd::lanes cloths, so no kernel needs a tail loop
+// written by Yuxuan Huang
+
+#include "ClothEnsemble.h"
+
+namespace {
+
+	typedef simd::vfloat V;
+
+	// register of item i, base is the first float of the group
+	inline V at(const simd::aligned_floats& a, int base, int i) {
+		return simd::load<V>(a.data() + base + i * simd::lanes);
+	}
+
+	inline void put(simd::aligned_floats& a, int base, int i, V v) {
+		simd::store(a.data() + base + i * simd::lanes, v);
+	}
+}
+
+ClothEnsemble::ClothEnsemble(int l, int w, const vector<instance>& cloths) {
+	length = l;
+	width = w;
+	count = cloths.size();
+	groups = (count + simd::lanes - 1) / simd::lanes;
+
+	int n = length * width;
+	int slots = groups * simd::lanes;
+	simd::aligned_floats* vertex_arrays[] = { &px, &py, &pz, &vx, &vy, &vz };
+	for (simd::aligned_floats* a : vertex_arrays) a->assign(slots * n, 0.0f);
+	simd::aligned_floats* vertical[] = { &vfx, &vfy, &vfz };
+	for (simd::aligned_floats* a : vertical) a->assign(slots * length * (width - 1), 0.0f);
+	simd::aligned_floats* horizontal[] = { &hfx, &hfy, &hfz };
+	for (simd::aligned_floats* a : horizontal) a->assign(slots * (length - 1) * width, 0.0f);
+	simd::aligned_floats* triangle[] = { &tfx, &tfy, &tfz };
+	for (simd::aligned_floats* a : triangle) a->assign(slots * 2 * (length - 1) * (width - 1), 0.0f);
+	simd::aligned_floats* params[] = { &k, &kv, &restlen, &spring_scale, &drag_scale, &gravity, &wx, &wy, &wz, &ox, &oy, &oz, &orad };
+	for (simd::aligned_floats* a : params) a->assign(slots, 0.0f);
+
+	// same pins as Cloth
+	free_mask.assign(n, 1.0f);
+	free_mask[0] = 0.0f;
+	free_mask[(length / 3) * width] = 0.0f;
+	free_mask[(2 * length / 3) * width] = 0.0f;
+	free_mask[(length - 1) * width] = 0.0f;
+
+	// the padding lanes run copies of the first cloth, so they stay finite and are never read back
+	for (int c = 0; c < slots; c++) {
+		const instance& p = cloths[c < count ? c : 0];
+		set_lane(k, c, p.k);
+		set_lane(kv, c, p.kv);
+		set_lane(restlen, c, p.restlen);
+		set_lane(spring_scale, c, 0.5f / p.mass); // the explicit solver halves the string forces
+		set_lane(drag_scale, c, 1.0f / p.mass);
+		set_lane(gravity, c, p.gravity);
+		set_lane(wx, c, p.wind.x);
+		set_lane(wy, c, p.wind.y);
+		set_lane(wz, c, p.wind.z);
+		set_lane(oz, c, -1e4f); // no sphere until set_obstacle()
+
+		// same starting layout as Cloth
+		glm::vec3 upperleft((length - 1) * p.restlen / 2.0f, 0.0f, (width - 1) * p.restlen);
+		int base = (c / simd::lanes) * n * simd::lanes + c % simd::lanes;
+		for (int i = 0; i < length; i++) {
+			for (int j = 0; j < width; j++) {
+				int o = base + (i * width + j) * simd::lanes;
+				px[o] = upperleft.x - i * p.restlen;
+				py[o] = upperleft.y + j * p.restlen;
+				pz[o] = upperleft.z;
+			}
+		}
+	}
+}
+
+void ClothEnsemble::set_lane(simd::aligned_floats& a, int cloth, float v) {
+	a[cloth] = v;
+}
+
+int ClothEnsemble::size() const {
+	return count;
+}
+
+void ClothEnsemble::set_obstacle(int cloth, glm::vec3 loc, float rad) {
+	set_lane(ox, cloth, loc.x);
+	set_lane(oy, cloth, loc.y);
+	set_lane(oz, cloth, loc.z);
+	set_lane(orad, cloth, rad);
+}
+
+void ClothEnsemble::set_wind(int cloth, glm::vec3 wind) {
+	set_lane(wx, cloth, wind.x);
+	set_lane(wy, cloth, wind.y);
+	set_lane(wz, cloth, wind.z);
+}
+
+glm::vec3 ClothEnsemble::position(int cloth, int vertex) const {
+	int o = ((cloth / simd::lanes) * length * width + vertex) * simd::lanes + cloth % simd::lanes;
+	return glm::vec3(px[o], py[o], pz[o]);
+}
+
+void ClothEnsemble::update(float total_dt, int substep) {
+	float dt = total_dt / substep;
+	for (int step = 0; step < substep; step++) {
+		for (int g = 0; g < groups; g++) {
+			string_forces(g);
+			drag(g);
+			integrate(g, dt);
+		}
+	}
+}
+
+// same as Cloth::string_force, for every string of simd::lanes cloths at once
+void ClothEnsemble::string_forces(int g) {
+	int vbase = g * length * width * simd::lanes;
+	int pbase = g * simd::lanes;
+	V ks = at(k, pbase, 0), kd = at(kv, pbase, 0), rest = at(restlen, pbase, 0);
+	int nv = length * (width - 1), nh = (length - 1) * width;
+
+	#pragma omp parallel for
+	for (int e = 0; e < nv + nh; e++) {
+		int a, b;
+		simd::aligned_floats *fx, *fy, *fz;
+		int fbase, slot;
+		if (e < nv) { // vertical
+			int i = e / (width - 1), j = e % (width - 1);
+			a = i * width + j;
+			b = a + 1;
+			fx = &vfx; fy = &vfy; fz = &vfz;
+			fbase = g * nv * simd::lanes;
+			slot = e;
+		}
+		else { // horizontal
+			slot = e - nv;
+			a = slot;
+			b = a + width;
+			fx = &hfx; fy = &hfy; fz = &hfz;
+			fbase = g * nh * simd::lanes;
+		}
+
+		V dx = simd::sub(at(px, vbase, b), at(px, vbase, a));
+		V dy = simd::sub(at(py, vbase, b), at(py, vbase, a));
+		V dz = simd::sub(at(pz, vbase, b), at(pz, vbase, a));
+		V len = simd::sqrt(simd::madd(dx, dx, simd::madd(dy, dy, simd::mul(dz, dz))));
+		V stringF = simd::mul(simd::sub(simd::set1<V>(0.0f), ks), simd::sub(len, rest)); // elastic force in the string
+
+		dx = simd::div(dx, len);
+		dy = simd::div(dy, len);
+		dz = simd::div(dz, len);
+		V dvx = simd::sub(at(vx, vbase, a), at(vx, vbase, b));
+		V dvy = simd::sub(at(vy, vbase, a), at(vy, vbase, b));
+		V dvz = simd::sub(at(vz, vbase, a), at(vz, vbase, b));
+		V dampF = simd::mul(kd, simd::madd(dvx, dx, simd::madd(dvy, dy, simd::mul(dvz, dz)))); // damping force in the string
+
+		V f = simd::add(stringF, dampF);
+		put(*fx, fbase, slot, simd::mul(f, dx));
+		put(*fy, fbase, slot, simd::mul(f, dy));
+		put(*fz, fbase, slot, simd::mul(f, dz));
+	}
+}
+
+// same force and slots as Cloth::drag, the vertices gather them in integrate()
+void ClothEnsemble::drag(int g) {
+	int vbase = g * length * width * simd::lanes;
+	int pbase = g * simd::lanes;
+	int nq = (length - 1) * (width - 1);
+	int tbase = g * 2 * nq * simd::lanes;
+	V wind[3] = { at(wx, pbase, 0), at(wy, pbase, 0), at(wz, pbase, 0) };
+	V third = simd::set1<V>(1.0f / 3.0f);
+	float c = 2.0f; // drag coefficient of Cloth::drag
+	V coef = simd::set1<V>(-0.5f * c / 2.0f / 3.0f); // the /2 turns the cross product into the area, /3 spreads it over the vertices
+
+	#pragma omp parallel for
+	for (int q = 0; q < nq; q++) {
+		int i = q / (width - 1), j = q % (width - 1);
+		int ind[4] = { i * width + j, i * width + j + 1, (i + 1) * width + j + 1, (i + 1) * width + j };
+		V p[4][3], v[4][3];
+		for (int m = 0; m < 4; m++) {
+			p[m][0] = at(px, vbase, ind[m]); p[m][1] = at(py, vbase, ind[m]); p[m][2] = at(pz, vbase, ind[m]);
+			v[m][0] = at(vx, vbase, ind[m]); v[m][1] = at(vy, vbase, ind[m]); v[m][2] = at(vz, vbase, ind[m]);
+		}
+
+		// triangle 0 is (0, 1, 2), triangle 1 is (0, 2, 3)
+		for (int t = 0; t < 2; t++) {
+			int tb = t == 0 ? 1 : 2, tc = t == 0 ? 2 : 3;
+			V e1[3], e2[3], n[3], u[3];
+			for (int d = 0; d < 3; d++) {
+				e1[d] = simd::sub(p[tb][d], p[0][d]);
+				e2[d] = simd::sub(p[tc][d], p[0][d]);
+				u[d] = simd::sub(simd::mul(simd::add(simd::add(v[0][d], v[tb][d]), v[tc][d]), third), wind[d]); // relative air velocity
+			}
+			n[0] = simd::sub(simd::mul(e1[1], e2[2]), simd::mul(e1[2], e2[1]));
+			n[1] = simd::sub(simd::mul(e1[2], e2[0]), simd::mul(e1[0], e2[2]));
+			n[2] = simd::sub(simd::mul(e1[0], e2[1]), simd::mul(e1[1], e2[0]));
+
+			V ulen = simd::sqrt(simd::madd(u[0], u[0], simd::madd(u[1], u[1], simd::mul(u[2], u[2]))));
+			V nlen = simd::sqrt(simd::madd(n[0], n[0], simd::madd(n[1], n[1], simd::mul(n[2], n[2]))));
+			V un = simd::madd(u[0], n[0], simd::madd(u[1], n[1], simd::mul(u[2], n[2])));
+			V s = simd::div(simd::mul(coef, simd::mul(ulen, un)), nlen);
+			put(tfx, tbase, 2 * q + t, simd::mul(s, n[0]));
+			put(tfy, tbase, 2 * q + t, simd::mul(s, n[1]));
+			put(tfz, tbase, 2 * q + t, simd::mul(s, n[2]));
+		}
+	}
+}
+
+void ClothEnsemble::integrate(int g, float dt) {
+	int vbase = g * length * width * simd::lanes;
+	int pbase = g * simd::lanes;
+	int vsbase = g * length * (width - 1) * simd::lanes;
+	int hsbase = g * (length - 1) * width * simd::lanes;
+	int tbase = g * 2 * (length - 1) * (width - 1) * simd::lanes;
+	V sscale = at(spring_scale, pbase, 0), dscale = at(drag_scale, pbase, 0), grav = at(gravity, pbase, 0);
+	V c[3] = { at(ox, pbase, 0), at(oy, pbase, 0), at(oz, pbase, 0) };
+	V reach = simd::add(at(orad, pbase, 0), simd::set1<V>(0.1f));
+	V surface = simd::add(at(orad, pbase, 0), simd::set1<V>(0.2f));
+	V zero = simd::set1<V>(0.0f), h = simd::set1<V>(dt);
+	const simd::aligned_floats* sf[2][3] = { { &vfx, &vfy, &vfz }, { &hfx, &hfy, &hfz } };
+	const simd::aligned_floats* tf[3] = { &tfx, &tfy, &tfz };
+
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) {
+			int ind = i * width + j;
+			if (free_mask[ind] == 0.0f) continue; // exclude the pins
+
+			V a[3], p[3], v[3];
+			for (int d = 0; d < 3; d++) {
+				// strings, as in Cloth::gather
+				V f = zero;
+				if (j > 0) f = simd::add(f, at(*sf[0][d], vsbase, i * (width - 1) + j - 1));
+				if (j < width - 1) f = simd::sub(f, at(*sf[0][d], vsbase, i * (width - 1) + j));
+				if (i > 0) f = simd::add(f, at(*sf[1][d], hsbase, (i - 1) * width + j));
+				if (i < length - 1) f = simd::sub(f, at(*sf[1][d], hsbase, i * width + j));
+
+				// drag of every triangle around the vertex
+				V t = zero;
+				if (i < length - 1 && j < width - 1) {
+					int q = i * (width - 1) + j;
+					t = simd::add(t, simd::add(at(*tf[d], tbase, 2 * q), at(*tf[d], tbase, 2 * q + 1)));
+				}
+				if (i < length - 1 && j > 0) t = simd::add(t, at(*tf[d], tbase, 2 * (i * (width - 1) + j - 1)));
+				if (i > 0 && j > 0) {
+					int q = (i - 1) * (width - 1) + j - 1;
+					t = simd::add(t, simd::add(at(*tf[d], tbase, 2 * q), at(*tf[d], tbase, 2 * q + 1)));
+				}
+				if (i > 0 && j < width - 1) t = simd::add(t, at(*tf[d], tbase, 2 * ((i - 1) * (width - 1) + j) + 1));
+				a[d] = simd::madd(f, sscale, simd::mul(t, dscale));
+			}
+			a[2] = simd::add(a[2], grav);
+
+			const simd::aligned_floats* pa[3] = { &px, &py, &pz };
+			const simd::aligned_floats* va[3] = { &vx, &vy, &vz };
+			for (int d = 0; d < 3; d++) {
+				v[d] = simd::madd(a[d], h, at(*va[d], vbase, ind));
+				p[d] = simd::madd(v[d], h, at(*pa[d], vbase, ind));
+			}
+
+			// sphere of every cloth, the lanes that do not touch theirs get a zero weight
+			V r[3];
+			for (int d = 0; d < 3; d++) r[d] = simd::sub(p[d], c[d]);
+			V len = simd::max(simd::sqrt(simd::madd(r[0], r[0], simd::madd(r[1], r[1], simd::mul(r[2], r[2])))), simd::set1<V>(1e-6f));
+			V hit = simd::le(len, reach);
+			V vn = zero;
+			for (int d = 0; d < 3; d++) {
+				r[d] = simd::div(r[d], len);
+				vn = simd::madd(v[d], r[d], vn);
+			}
+			V bounce = simd::mul(simd::mul(hit, simd::le(vn, zero)), simd::mul(simd::set1<V>(-1.1f), vn)); // (1 + alpha), alpha = 0.1
+			for (int d = 0; d < 3; d++) {
+				V target = simd::madd(surface, r[d], c[d]);
+				p[d] = simd::madd(hit, simd::sub(target, p[d]), p[d]);
+				v[d] = simd::madd(bounce, r[d], v[d]);
+			}
+
+			put(px, vbase, ind, p[0]); put(py, vbase, ind, p[1]); put(pz, vbase, ind, p[2]);
+			put(vx, vbase, ind, v[0]); put(vy, vbase, ind, v[1]); put(vz, vbase, ind, v[2]);
+		}
+	}
+}
+
+void ClothEnsemble::write_render(int cloth, float* out) const {
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) {
+			glm::vec3 p = position(cloth, i * width + j);
+
+			// sum of the unit normals of the triangles around the vertex, like Cloth::drag
+			glm::vec3 nr(0.0f);
+			for (int qi = i - 1; qi <= i; qi++) {
+				for (int qj = j - 1; qj <= j; qj++) {
+					if (qi < 0 || qj < 0 || qi >= length - 1 || qj >= width - 1) continue;
+					glm::vec3 q0 = position(cloth, qi * width + qj), q1 = position(cloth, qi * width + qj + 1);
+					glm::vec3 q2 = position(cloth, (qi + 1) * width + qj + 1), q3 = position(cloth, (qi + 1) * width + qj);
+					bool corner0 = qi == i && qj == j, corner2 = qi == i - 1 && qj == j - 1;
+					if (corner0 || corner2 || (qi == i && qj == j - 1)) nr += glm::normalize(glm::cross(q1 - q0, q2 - q0)); // triangle 0
+					if (corner0 || corner2 || (qi == i - 1 && qj == j)) nr += glm::normalize(glm::cross(q2 - q0, q3 - q0)); // triangle 1
+				}
+			}
+			nr = glm::normalize(nr);
+
+			float* v = out + 6 * (i * width + j);
+			v[0] = p.x; v[1] = p.y; v[2] = p.z;
+			v[3] = nr.x; v[4] = nr.y; v[5] = nr.z;
+		}
+	}
+}
@@ -0,0 +1,64 @@
+// Many same-sized string-based cloths simulated together, one cloth per SIMD lane
+// every cloth has its own parameters, wind and sphere, and all of them go through
+// the string, drag and integration stages of the explicit solver in lockstep
+// written by Yuxuan Huang
+
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include "../../../glm/glm.hpp"
+#include "../../../glm/gtc/matrix_transform.hpp"
+#include "../../../glm/gtc/type_ptr.hpp"
+
+#include <vector>
+
+#include "../../Tools/SIMD.h"
+
+using namespace std;
+
+class ClothEnsemble {
+
+public:
+	// parameters of one cloth, the same ones the Cloth constructor takes
+	struct instance {
+		float gravity;
+		float restlen, mass;
+		float k, kv;
+		glm::vec3 wind; // wind velocity
+	};
+
+	int length, width;
+
+	ClothEnsemble(int length, int width, const vector<instance>& cloths);
+
+	void update(float dt, int substep); // explicit Euler, like Cloth with the vec3 or x/y/z storage
+
+	int size() const; // number of cloths
+	void set_obstacle(int cloth, glm::vec3 loc, float rad); // sphere of one cloth
+	void set_wind(int cloth, glm::vec3 wind);
+	glm::vec3 position(int cloth, int vertex) const;
+	void write_render(int cloth, float* out) const; // interleaved position & unit normal, same layout as Cloth::write_render
+
+private:
+	int count; // number of cloths
+	int groups; // SIMD registers per vertex, the last one padded with copies of cloth 0
+
+	// every array holds groups * items * lanes floats: item i of group g is at (g * items + i) * lanes
+	simd::aligned_floats px, py, pz; // positions
+	simd::aligned_floats vx, vy, vz; // velocities
+	simd::aligned_floats vfx, vfy, vfz; // vertical string forces, length * (width - 1) items
+	simd::aligned_floats hfx, hfy, hfz; // horizontal string forces, (length - 1) * width items
+	simd::aligned_floats tfx, tfy, tfz; // drag per vertex of every triangle, 2 * (length - 1) * (width - 1) items
+	vector<float> free_mask; // 0 for the pins, the same in every cloth
+
+	// per cloth parameters, groups * lanes floats
+	simd::aligned_floats k, kv, restlen;
+	simd::aligned_floats spring_scale, drag_scale, gravity; // 0.5 / mass, 1 / mass, gravity
+	simd::aligned_floats wx, wy, wz; // wind
+	simd::aligned_floats ox, oy, oz, orad; // sphere
+
+	void set_lane(simd::aligned_floats& a, int cloth, float v);
+	void string_forces(int g);
+	void drag(int g);
+	void integrate(int g, float dt);
+};
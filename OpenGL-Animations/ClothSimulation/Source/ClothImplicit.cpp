@@ -0,0 +1,320 @@
+// Implicit (backward Euler) integration of the string-based cloth
+// following Baraff & Witkin, "Large Steps in Cloth Simulation"
+// the linear system is never assembled: its product with a vector is computed string by string,
+// and the system is solved with a Jacobi preconditioned conjugate gradient, filtered for the pins and
+// for the vertices resting on the sphere
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+namespace {
+
+	// contribution of one string to A x, with dx = x[a] - x[b]
+	// c_damp * u u^T dx + c_stiff * (u u^T + c (I - u u^T)) dx
+	inline glm::vec3 string_term(const glm::vec3& u, float c, const glm::vec3& dx, float c_damp, float c_stiff) {
+		glm::vec3 along = glm::dot(u, dx) * u;
+		return c_damp * along + c_stiff * (along + c * (dx - along));
+	}
+
+	// contribution of one string to the diagonal of A
+	inline glm::vec3 string_diag(const glm::vec3& u, float c, float c_damp, float c_stiff) {
+		glm::vec3 uu = u * u;
+		return c_damp * uu + c_stiff * (uu + c * (glm::vec3(1.0f) - uu));
+	}
+
+	// the part of x a vertex may change: none of it for a pin, and only what is tangent to the sphere
+	// for a vertex resting on it (n is its normal, zero for a free vertex)
+	inline glm::vec3 filtered(const glm::vec3& x, const glm::vec3& n, float mask) {
+		return (x - glm::dot(n, x) * n) * mask;
+	}
+
+	// vertices this close to the surface of the sphere rest on it, and are put back 0.2 away from it
+	const float contact_skin = 0.3f;
+}
+
+void Cloth::init_implicit() {
+	int n = length * width;
+	cg_max_iter = 50;
+	cg_tol = 1e-4f;
+	cg_iter_used = 0;
+
+	vdir.assign(length * (width - 1), glm::vec3(0.0f));
+	vcoef.assign(length * (width - 1), 0.0f);
+	vprod.assign(length * (width - 1), glm::vec3(0.0f));
+	hdir.assign((length - 1) * width, glm::vec3(0.0f));
+	hcoef.assign((length - 1) * width, 0.0f);
+	hprod.assign((length - 1) * width, glm::vec3(0.0f));
+
+	vector<glm::vec3>* cg_vectors[] = { &cg_b, &cg_r, &cg_z, &cg_d, &cg_q, &cg_dv, &cg_diag, &cg_n };
+	for (vector<glm::vec3>* v : cg_vectors) v->assign(n, glm::vec3(0.0f));
+	cg_release.assign(n, 0);
+	cg_row.assign(2 * length, 0.0);
+}
+
+void Cloth::set_cg(int max_iterations, float tolerance) {
+	cg_max_iter = max_iterations;
+	cg_tol = tolerance;
+}
+
+int Cloth::cg_iterations() const {
+	return cg_iter_used;
+}
+
+// each substep solves (M - h D - h^2 K) dv = h (f0 + h K v0)
+// K and D are the position and velocity jacobians of the string forces,
+// drag and gravity are treated explicitly, and the sphere holds the vertices resting on it inside the solve
+void Cloth::update_implicit(float total_dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad) {
+
+	float h = total_dt / substep;
+	float half = 0.5f; // the explicit solver halves the string forces as well
+	int n = length * width;
+	cg_iter_used = 0;
+
+	for (int step = 0; step < substep; step++) {
+
+		// explicit forces
+		advance_wind(h, false);
+		drag(gforce);
+		spring_forces();
+		spring_batch_forces();
+		spring_jacobians();
+
+		// right hand side, -h^2 K v0 is the stiffness part of A applied to v0
+		apply_system(vel, cg_q, 0.0f, 0.0f, h * h * half);
+		#pragma omp parallel for
+		for (int i = 0; i < length; i++) {
+			for (int j = 0; j < width; j++) {
+				int ind = i * width + j;
+				glm::vec3 f = 0.5f * (gather(vforce, hforce, i, j) + sforce[ind]) + gforce[ind];
+				f.z += vertex_mass[ind] * gravity;
+				cg_b[ind] = h * f - cg_q[ind];
+			}
+		}
+
+		glm::vec3 obs0 = obs_at(obs_from, obs_loc, step, substep);
+		glm::vec3 obs1 = obs_at(obs_from, obs_loc, step + 1, substep);
+		int contacts = sphere_contacts(obs0, obs1, obs_rad, h);
+		cg_iter_used += solve_implicit(h * half, h * h * half, contacts);
+
+		// update speed and position, and catch the vertices that reach the sphere during the step
+		// unlike the explicit solver, every vertex within contact_skin is put back and none bounces: with steps as long
+		// as a frame, a bounce or a vertex that sits outside the reach after being put back pumps the strain energy
+		// of the strings around the sphere into the vertices touching it
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++) {
+			if (free_mask[i] == 0.0f) continue; // exclude the pins
+			glm::vec3 start = pos[i];
+			vel[i] += cg_dv[i];
+			pos[i] += vel[i] * h;
+			cloth_kernels::sweep_sphere<float>(pos[i], vel[i], start, obs0, obs1, obs_rad, h, contact_skin, 0.0f);
+			if (!colliders.empty()) collide_meshes(pos[i], vel[i]);
+		}
+		move_attached(step, substep, total_dt, false);
+		limit_strain(false);
+		self_collide();
+	}
+}
+
+// Baraff & Witkin constrain a vertex resting on the sphere in the solve itself: its velocity change along the
+// normal is fixed so that it moves with the sphere along it, and the solver only looks for the tangential part.
+// Pushed out by collide() after an unconstrained step instead, the vertex ends up far from where the strings put
+// it, and at one substep per frame the cloth around the sphere stretches further every frame.
+// A vertex leaving the sphere, or one the sphere had to hold back in the last substep, is left free.
+int Cloth::sphere_contacts(glm::vec3 obs0, glm::vec3 obs1, float obs_rad, float h) {
+	int n = length * width;
+	glm::vec3 obs_vel = (obs1 - obs0) / h;
+	float reach = obs_rad + contact_skin;
+	int contacts = 0;
+	#pragma omp parallel for reduction(+:contacts)
+	for (int i = 0; i < n; i++) {
+		glm::vec3 rel = pos[i] - obs0;
+		float dist2 = glm::dot(rel, rel);
+		glm::vec3 normal(0.0f);
+		if (free_mask[i] != 0.0f && !cg_release[i] && dist2 < reach * reach && dist2 > 0.0f) {
+			normal = rel / sqrt(dist2);
+			if (glm::dot(vel[i] - obs_vel, normal) > 0.0f) normal = glm::vec3(0.0f); // on its way out
+		}
+		cg_n[i] = normal;
+		if (normal != glm::vec3(0.0f)) cg_dv[i] = glm::dot(obs_vel - vel[i], normal) * normal;
+		else cg_dv[i] *= free_mask[i]; // the last velocity change is the first guess
+		contacts += normal != glm::vec3(0.0f);
+	}
+	return contacts;
+}
+
+void Cloth::spring_jacobians() {
+	// vertical
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width - 1; j++) {
+			int e = i * (width - 1) + j;
+			glm::vec3 d = pos[i * width + j + 1] - pos[i * width + j];
+			float len = glm::length(d);
+			vdir[e] = d / len;
+			vcoef[e] = glm::max(0.0f, 1.0f - restlen / len); // compressed strings would make the system indefinite
+		}
+	}
+
+	// horizontal
+	#pragma omp parallel for
+	for (int i = 0; i < length - 1; i++) {
+		for (int j = 0; j < width; j++) {
+			int e = i * width + j;
+			glm::vec3 d = pos[(i + 1) * width + j] - pos[i * width + j];
+			float len = glm::length(d);
+			hdir[e] = d / len;
+			hcoef[e] = glm::max(0.0f, 1.0f - restlen / len);
+		}
+	}
+
+	// shear and bending springs
+	int first = batch_start[extra_batch], last = springs.size();
+	#pragma omp parallel for
+	for (int c = first; c < last; c++) {
+		glm::vec3 d = pos[springs[c].b] - pos[springs[c].a];
+		float len = glm::length(d);
+		sdir[c] = d / len;
+		scoef[c] = glm::max(0.0f, 1.0f - springs[c].rest / len);
+	}
+}
+
+// y = m M x + sum over strings of the string terms, added to the first end and subtracted from the second
+// like the force pass, the terms go to per-string slots first and every vertex gathers its own,
+// so nothing is shared between threads
+void Cloth::apply_system(const vector<glm::vec3>& x, vector<glm::vec3>& y, float m, float c_damp, float c_stiff) {
+	float damp = c_damp * kv, stiff = c_stiff * k; // of the structural strings
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width - 1; j++) {
+			int e = i * (width - 1) + j;
+			vprod[e] = string_term(vdir[e], vcoef[e], x[i * width + j] - x[i * width + j + 1], damp, stiff);
+		}
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < length - 1; i++) {
+		for (int j = 0; j < width; j++) {
+			int e = i * width + j;
+			hprod[e] = string_term(hdir[e], hcoef[e], x[i * width + j] - x[(i + 1) * width + j], damp, stiff);
+		}
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) {
+			int ind = i * width + j;
+			y[ind] = (m * vertex_mass[ind]) * x[ind] - gather(vprod, hprod, i, j);
+		}
+	}
+
+	// shear and bending springs scatter straight into y, batch by batch
+	for (int b = extra_batch; b < batch_start.size() - 1; b++) {
+		#pragma omp parallel for
+		for (int c = batch_start[b]; c < batch_start[b + 1]; c++) {
+			const spring& s = springs[c];
+			glm::vec3 t = string_term(sdir[c], scoef[c], x[s.a] - x[s.b], c_damp * s.kv, c_stiff * s.k);
+			y[s.a] += t;
+			y[s.b] -= t;
+		}
+	}
+}
+
+double Cloth::row_sum(int s) const {
+	double total = 0.0;
+	for (int i = 0; i < length; i++) total += cg_row[2 * i + s];
+	return total;
+}
+
+// the dot products are summed per row and the rows in order, so the iterations do not depend on the threads
+int Cloth::solve_implicit(float c_damp, float c_stiff, int contacts) {
+	int n = length * width;
+
+	// inverse of the diagonal as the preconditioner, zero for pins so they stay filtered out
+	float damp = c_damp * kv, stiff = c_stiff * k; // of the structural strings
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) {
+			glm::vec3 d(vertex_mass[i * width + j]);
+			if (j > 0) d += string_diag(vdir[i * (width - 1) + j - 1], vcoef[i * (width - 1) + j - 1], damp, stiff);
+			if (j < width - 1) d += string_diag(vdir[i * (width - 1) + j], vcoef[i * (width - 1) + j], damp, stiff);
+			if (i > 0) d += string_diag(hdir[(i - 1) * width + j], hcoef[(i - 1) * width + j], damp, stiff);
+			if (i < length - 1) d += string_diag(hdir[i * width + j], hcoef[i * width + j], damp, stiff);
+			cg_diag[i * width + j] = d;
+		}
+	}
+	for (int b = extra_batch; b < batch_start.size() - 1; b++) {
+		#pragma omp parallel for
+		for (int c = batch_start[b]; c < batch_start[b + 1]; c++) {
+			glm::vec3 d = string_diag(sdir[c], scoef[c], c_damp * springs[c].kv, c_stiff * springs[c].k);
+			cg_diag[springs[c].a] += d;
+			cg_diag[springs[c].b] += d;
+		}
+	}
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) cg_diag[i] = free_mask[i] / cg_diag[i];
+
+	// start from the velocity change the contacts fix and the last one elsewhere, the residual is what is left to the free directions
+	apply_system(cg_dv, cg_q, 1.0f, c_damp, c_stiff);
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		double rz = 0.0, bb = 0.0;
+		for (int j = 0; j < width; j++) {
+			int ind = i * width + j;
+			glm::vec3 b = filtered(cg_b[ind], cg_n[ind], free_mask[ind]);
+			cg_r[ind] = filtered(cg_b[ind] - cg_q[ind], cg_n[ind], free_mask[ind]);
+			cg_z[ind] = filtered(cg_r[ind] * cg_diag[ind], cg_n[ind], free_mask[ind]);
+			cg_d[ind] = cg_z[ind];
+			rz += glm::dot(cg_r[ind], cg_z[ind]);
+			bb += glm::dot(b, b);
+		}
+		cg_row[2 * i] = rz;
+		cg_row[2 * i + 1] = bb;
+	}
+	double rz = row_sum(0), bb = row_sum(1);
+
+	int iter = 0;
+	while (bb > 0.0 && iter < cg_max_iter) {
+		iter++;
+		apply_system(cg_d, cg_q, 1.0f, c_damp, c_stiff);
+
+		#pragma omp parallel for
+		for (int i = 0; i < length; i++) {
+			double dq = 0.0;
+			for (int j = 0; j < width; j++) {
+				int ind = i * width + j;
+				cg_q[ind] = filtered(cg_q[ind], cg_n[ind], free_mask[ind]);
+				dq += glm::dot(cg_d[ind], cg_q[ind]);
+			}
+			cg_row[2 * i] = dq;
+		}
+		float alpha = float(rz / row_sum(0));
+
+		#pragma omp parallel for
+		for (int i = 0; i < length; i++) {
+			double rz_new = 0.0, rr = 0.0;
+			for (int j = 0; j < width; j++) {
+				int ind = i * width + j;
+				cg_dv[ind] += alpha * cg_d[ind];
+				cg_r[ind] -= alpha * cg_q[ind];
+				cg_z[ind] = filtered(cg_r[ind] * cg_diag[ind], cg_n[ind], free_mask[ind]);
+				rz_new += glm::dot(cg_r[ind], cg_z[ind]);
+				rr += glm::dot(cg_r[ind], cg_r[ind]);
+			}
+			cg_row[2 * i] = rz_new;
+			cg_row[2 * i + 1] = rr;
+		}
+		double rz_new = row_sum(0);
+		if (row_sum(1) <= double(cg_tol) * cg_tol * bb) break; // relative residual is small enough
+
+		float beta = float(rz_new / rz);
+		rz = rz_new;
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++) cg_d[i] = cg_z[i] + beta * cg_d[i];
+	}
+
+	// the sphere may only push: a vertex it had to pull back to keep on its surface goes free in the next substep
+	if (contacts > 0) apply_system(cg_dv, cg_q, 1.0f, c_damp, c_stiff);
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) cg_release[i] = contacts > 0 && glm::dot(cg_q[i] - cg_b[i], cg_n[i]) < 0.0f;
+	return iter;
+}
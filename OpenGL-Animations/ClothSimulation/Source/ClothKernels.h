@@ -0,0 +1,237 @@
+// The physics of the explicit grid solver, templated over the scalar type
+// Cloth runs them on floats, GridCloth on floats or doubles as a reference, so both
+// share one implementation of the strings, the drag, the Euler step and the sphere collision, and one
+// substep loop (explicit_substep) around them; nothing else of Cloth is templated
+// written by Yuxuan Huang
+
+#pragma once
+
+#include <cmath>
+
+#define GLM_FORCE_RADIANS
+#include "../../../glm/glm.hpp"
+
+namespace cloth_kernels {
+
+	template<class T> struct vec3_of;
+	template<> struct vec3_of<float> { typedef glm::vec3 type; };
+	template<> struct vec3_of<double> { typedef glm::dvec3 type; };
+
+	// length and width of the grid
+	struct grid {
+		int length, width;
+	};
+
+	// force in the string from conjunction a to b
+	template<class T>
+	inline typename vec3_of<T>::type string_force(const typename vec3_of<T>::type* pos, const typename vec3_of<T>::type* vel,
+		int a, int b, T ks, T kd, T rest) {
+		typename vec3_of<T>::type delta_p = pos[b] - pos[a];
+		T len = glm::length(delta_p); // len is the distance between two conjunctions
+		T stringF = -ks * (len - rest); // elastic force in the string
+
+		delta_p /= len; // delta_p is now the unit direction
+		T v1 = glm::dot(vel[a], delta_p);
+		T v2 = glm::dot(vel[b], delta_p);
+		T dampF = kd * (v1 - v2); // damping force in the string
+
+		return (stringF + dampF) * delta_p;
+	}
+
+	// force in every structural string, each string writes its own slot so both loops run in parallel
+	// vforce holds the vertical strings, length * (width - 1), hforce the horizontal ones, (length - 1) * width
+	// strings between two sleeping vertices are skipped when active is given
+	template<class T>
+	void string_forces(grid g, const typename vec3_of<T>::type* pos, const typename vec3_of<T>::type* vel,
+		typename vec3_of<T>::type* vforce, typename vec3_of<T>::type* hforce, T k, T kv, T restlen, const unsigned char* active) {
+		int length = g.length, width = g.width;
+		// vertical
+		#pragma omp parallel for
+		for (int i = 0; i < length; i++) {
+			for (int j = 0; j < width - 1; j++) {
+				if (active && !active[i * width + j] && !active[i * width + j + 1]) continue; // between two sleeping vertices
+				vforce[i * (width - 1) + j] = string_force<T>(pos, vel, i * width + j, i * width + j + 1, k, kv, restlen);
+			}
+		}
+
+		// horizontal
+		#pragma omp parallel for
+		for (int i = 0; i < length - 1; i++) {
+			for (int j = 0; j < width; j++) {
+				if (active && !active[i * width + j] && !active[(i + 1) * width + j]) continue;
+				hforce[i * width + j] = string_force<T>(pos, vel, i * width + j, (i + 1) * width + j, k, kv, restlen);
+			}
+		}
+	}
+
+	// net per-string value on vertex (i, j)
+	template<class T>
+	inline typename vec3_of<T>::type gather(grid g, const typename vec3_of<T>::type* v, const typename vec3_of<T>::type* h, int i, int j) {
+		int length = g.length, width = g.width;
+		typename vec3_of<T>::type sum(T(0));
+		if (j > 0) sum += v[i * (width - 1) + j - 1]; // upper string
+		if (j < width - 1) sum -= v[i * (width - 1) + j]; // lower string
+		if (i > 0) sum += h[(i - 1) * width + j]; // left string
+		if (i < length - 1) sum -= h[i * width + j]; // right string
+		return sum;
+	}
+
+	// drag on the two triangles of a quad whose corners are at p and v in the order (i, j), (i, j + 1), (i + 1, j + 1), (i + 1, j),
+	// with the air moving at w0 and w1 over them; t0 and t1 get the force on each vertex of either triangle
+	template<class T>
+	inline void quad_drag(const typename vec3_of<T>::type* const* p, const typename vec3_of<T>::type* const* v,
+		typename vec3_of<T>::type w0, typename vec3_of<T>::type w1, typename vec3_of<T>::type& t0, typename vec3_of<T>::type& t1) {
+		typedef typename vec3_of<T>::type vec;
+		T c = T(2);
+
+		// compute average vel for triangles
+		vec vtmp = *v[0] + *v[2];
+		vec v0 = (vtmp + *v[1]) / T(3) - w0; // average vel for the 1st triangle, relative to the air
+		vec v1 = (vtmp + *v[3]) / T(3) - w1; // ... for the 2nd triangle
+
+		// compute normal for triangles
+		vtmp = *p[2] - *p[0]; // diagonal vector
+		vec n0 = glm::cross(*p[1] - *p[0], vtmp); // unnormalized normal
+		vec n1 = glm::cross(vtmp, *p[3] - *p[0]);
+
+		// compute the final force, per vertex
+		vec f0 = T(-0.5) * c * (glm::length(v0) * glm::dot(v0, n0) / (T(2) * glm::length(n0))) * n0;
+		vec f1 = T(-0.5) * c * (glm::length(v1) * glm::dot(v1, n1) / (T(2) * glm::length(n1))) * n1;
+		t0 = f0 / T(3);
+		t1 = f1 / T(3);
+	}
+
+	// sum of the per-triangle values of the (up to six) triangles around vertex (i, j), always in the same order
+	// triangle 2 q of quad q has corners (i, j), (i, j + 1), (i + 1, j + 1), triangle 2 q + 1 has (i, j), (i + 1, j + 1), (i + 1, j)
+	template<class T>
+	inline typename vec3_of<T>::type gather_triangles(grid g, const typename vec3_of<T>::type* t, int i, int j) {
+		int length = g.length, width = g.width;
+		typename vec3_of<T>::type sum(T(0));
+		int w = width - 1;
+		if (i < length - 1 && j < width - 1) sum += t[2 * (i * w + j)] + t[2 * (i * w + j) + 1]; // quad below right, both triangles
+		if (i < length - 1 && j > 0) sum += t[2 * (i * w + j - 1)]; // quad below left, its first triangle
+		if (i > 0 && j > 0) sum += t[2 * ((i - 1) * w + j - 1)] + t[2 * ((i - 1) * w + j - 1) + 1]; // quad above left, both
+		if (i > 0 && j < width - 1) sum += t[2 * ((i - 1) * w + j) + 1]; // quad above right, its second triangle
+		return sum;
+	}
+
+	// drag of every quad into its two slots of t, then every vertex gathers the triangles around it into drag
+	// wind(q, w0, w1) sets the air velocity over the two triangles of quad q; when active is given,
+	// the quads whose four corners sleep are skipped
+	template<class T, class Wind>
+	void grid_drag(grid g, const typename vec3_of<T>::type* pos, const typename vec3_of<T>::type* vel,
+		typename vec3_of<T>::type* t, typename vec3_of<T>::type* drag, const unsigned char* active, Wind wind) {
+		typedef typename vec3_of<T>::type vec;
+		int length = g.length, width = g.width;
+		#pragma omp parallel for
+		for (int i = 0; i < length - 1; i++) {
+			for (int j = 0; j < width - 1; j++) {
+				int ind[4] = { i * width + j, i * width + j + 1, (i + 1) * width + j + 1, (i + 1) * width + j };
+				if (active && !(active[ind[0]] || active[ind[1]] || active[ind[2]] || active[ind[3]])) continue; // sleeping quad
+				const vec* p[4] = { &pos[ind[0]], &pos[ind[1]], &pos[ind[2]], &pos[ind[3]] };
+				const vec* v[4] = { &vel[ind[0]], &vel[ind[1]], &vel[ind[2]], &vel[ind[3]] };
+				int q = i * (width - 1) + j;
+				vec w0, w1;
+				wind(q, w0, w1);
+				quad_drag<T>(p, v, w0, w1, t[2 * q], t[2 * q + 1]);
+			}
+		}
+
+		#pragma omp parallel for
+		for (int i = 0; i < length; i++) {
+			for (int j = 0; j < width; j++) drag[i * width + j] = gather_triangles<T>(g, t, i, j);
+		}
+	}
+
+	// explicit Euler step of one vertex from its net string force f (halved, like every solver here) and drag,
+	// pins have a zero inverse mass and a zero mask, so they keep still without a special case
+	template<class T>
+	inline void euler(typename vec3_of<T>::type& p, typename vec3_of<T>::type& v, typename vec3_of<T>::type f,
+		typename vec3_of<T>::type drag, T inv_mass, T mask, T gravity, T dt) {
+		typename vec3_of<T>::type acc = (f * T(0.5) + drag) * inv_mass;
+		acc.z += gravity;
+		v = (v + acc * dt) * mask;
+		p += v * dt;
+	}
+
+	// the vertex moved from start to p while the sphere moved from obs_from to obs_to
+	// in the sphere's frame the vertex moves along a straight line, and the first time that line
+	// touches the sphere gives the side it hit, even if the sphere went all the way past the vertex
+	// a vertex within skin of the sphere is put back 0.2 away from it, and bounces off it with the restitution
+	// returns true if it hit
+	template<class T>
+	bool sweep_sphere(typename vec3_of<T>::type& p, typename vec3_of<T>::type& v, typename vec3_of<T>::type start,
+		typename vec3_of<T>::type obs_from, typename vec3_of<T>::type obs_to, T obs_rad, T dt, T skin = T(0.1), T restitution = T(0.1)) {
+		typedef typename vec3_of<T>::type vec;
+		T reach = obs_rad + skin;
+		vec rel0 = start - obs_from;
+		vec rel1 = p - obs_to;
+		vec n;
+
+		if (glm::dot(rel0, rel0) <= reach * reach) { // already touching at the start, resolve where it ends
+			if (glm::dot(rel1, rel1) > reach * reach) return false;
+			n = glm::length(rel1) > T(1e-6) ? glm::normalize(rel1) : glm::normalize(rel0);
+		}
+		else {
+			// smallest t in [0, 1] with |rel0 + t (rel1 - rel0)| = reach
+			vec d = rel1 - rel0;
+			T a = glm::dot(d, d);
+			T b = glm::dot(rel0, d);
+			T c = glm::dot(rel0, rel0) - reach * reach;
+			T end = glm::dot(rel1, rel1) - reach * reach;
+			if (end > T(0) && (b >= T(0) || -b >= a)) return false; // ends outside and the closest approach is at an end
+			T disc = b * b - a * c;
+			if (disc < T(0)) return false; // never gets close
+			T t = (-b - std::sqrt(disc)) / a;
+			if (t < T(0) || t > T(1)) return false;
+			n = glm::normalize(rel0 + t * d);
+		}
+
+		// push it out on the side it hit and bounce it off the moving surface
+		p = obs_to + (obs_rad + T(0.2)) * n;
+		vec obs_vel = (obs_to - obs_from) / dt;
+		T vns = glm::dot(v - obs_vel, n); // velocity parallel to normal, relative to the sphere
+		if (vns < T(0)) v -= (1 + restitution) * vns * n;
+		return true;
+	}
+
+	// the arrays of an explicit grid cloth that one substep reads and writes
+	template<class T>
+	struct explicit_state {
+		typedef typename vec3_of<T>::type vec;
+		vec* pos;
+		vec* vel;
+		vec* vforce; // per string, as in string_forces
+		vec* hforce;
+		vec* tforce; // per corner of every triangle, as in gather_triangles
+		vec* gforce; // drag on every vertex
+		const vec* extra; // another force on every vertex, halved with the strings (the springs of Cloth), or null
+		const T* inv_mass;
+		const T* free_mask;
+		const unsigned char* active; // null when nothing sleeps
+	};
+
+	// one substep of the explicit solver: the structural strings, the drag, and the Euler step of every vertex
+	// from the forces it gathers in a fixed order, so the result does not depend on the number of threads
+	// wind is passed on to grid_drag, and collide(ind, start) handles the obstacles of a free vertex that moved from start
+	template<class T, class Wind, class Collide>
+	void explicit_substep(grid g, const explicit_state<T>& s, T k, T kv, T restlen, T gravity, T dt, Wind wind, Collide collide) {
+		typedef typename vec3_of<T>::type vec;
+		int length = g.length, width = g.width;
+		string_forces<T>(g, s.pos, s.vel, s.vforce, s.hforce, k, kv, restlen, s.active);
+		grid_drag<T>(g, s.pos, s.vel, s.tforce, s.gforce, s.active, wind);
+
+		#pragma omp parallel for
+		for (int i = 0; i < length; i++) {
+			for (int j = 0; j < width; j++) {
+				int ind = i * width + j;
+				if (s.active && !s.active[ind]) continue; // sleeping
+				vec start = s.pos[ind];
+				vec f = gather<T>(g, s.vforce, s.hforce, i, j);
+				if (s.extra) f += s.extra[ind];
+				euler<T>(s.pos[ind], s.vel[ind], f, s.gforce[ind], s.inv_mass[ind], s.free_mask[ind], gravity, dt);
+				if (s.free_mask[ind] != T(0)) collide(ind, start);
+			}
+		}
+	}
+}
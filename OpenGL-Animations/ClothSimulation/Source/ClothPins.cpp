@@ -0,0 +1,114 @@
+// Pins, attachments and per-vertex masses of the string-based cloth
+// a pinned vertex has a zero inverse mass and a zero free_mask, so the integration loops treat every vertex
+// the same way and the pins just never move; an attachment is a pin with a target that can move between
+// updates, and the vertex is carried there in a straight line over the substeps of the next update
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+#include <algorithm>
+
+void Cloth::init_pins() {
+	int n = length * width;
+	vertex_mass.assign(n, mass);
+	inv_mass.assign(n, 1.0f / mass);
+	free_mask.assign(n, 1.0f);
+	min_mass = mass;
+	attachments.clear();
+	pins.clear();
+	tethers_valid = false;
+
+	// four pins along the top edge
+	set_pinned(0, 0, true);
+	set_pinned(length / 3, 0, true);
+	set_pinned(2 * length / 3, 0, true);
+	set_pinned(length - 1, 0, true);
+}
+
+void Cloth::set_pinned(int i, int j, bool pinned) {
+	if (i < 0 || i >= length || j < 0 || j >= width) return; // not a vertex of the cloth
+	int ind = i * width + j;
+	free_mask[ind] = pinned ? 0.0f : 1.0f;
+	inv_mass[ind] = pinned ? 0.0f : 1.0f / vertex_mass[ind];
+	if (pinned) vel[ind] = glm::vec3(0.0f);
+	else {
+		for (int a = 0; a < attachments.size(); a++) {
+			if (attachments[a].vertex == ind) attachments[a].vertex = -1; // the id stays valid, it just moves nothing
+		}
+	}
+
+	// pins stays sorted by index, so only this vertex goes in or out
+	auto at = lower_bound(pins.begin(), pins.end(), ind);
+	bool listed = at != pins.end() && *at == ind;
+	if (pinned && !listed) pins.insert(at, ind);
+	if (!pinned && listed) pins.erase(at);
+	if (pinned != listed) tethers_valid = false;
+	if (sleeping) wake_all();
+}
+
+void Cloth::set_vertex_mass(int i, int j, float m) {
+	if (i < 0 || i >= length || j < 0 || j >= width || m <= 0.0f) return;
+	int ind = i * width + j;
+	float old = vertex_mass[ind];
+	vertex_mass[ind] = m;
+	if (free_mask[ind] != 0.0f) inv_mass[ind] = 1.0f / m;
+	if (m <= min_mass) min_mass = m;
+	else if (old == min_mass) { // the lightest vertex got heavier
+		min_mass = vertex_mass[0];
+		for (int v = 1; v < length * width; v++) min_mass = glm::min(min_mass, vertex_mass[v]);
+	}
+}
+
+int Cloth::add_attachment(int i, int j) {
+	if (i < 0 || i >= length || j < 0 || j >= width) return -1;
+	set_pinned(i, j, true);
+	attachment a;
+	a.vertex = i * width + j;
+	a.from = pos[a.vertex];
+	a.to = pos[a.vertex];
+	attachments.push_back(a);
+	return attachments.size() - 1;
+}
+
+void Cloth::move_attachment(int id, glm::vec3 target) {
+	if (id < 0 || id >= attachments.size() || attachments[id].to == target) return;
+	attachments[id].to = target;
+	if (sleeping) wake_all(); // the tiles around it have to follow
+}
+
+void Cloth::clear_pins() {
+	attachments.clear();
+	for (int v : pins) {
+		free_mask[v] = 1.0f;
+		inv_mass[v] = 1.0f / vertex_mass[v];
+	}
+	pins.clear();
+	tethers_valid = false;
+	if (sleeping) wake_all();
+}
+
+// called after the integration of every substep, the attached vertices are where their straight path
+// from the start of the update puts them, and move with its velocity so the string damping sees it
+void Cloth::move_attached(int step, int substep, float total_dt, bool soa) {
+	float s = float(step + 1) / substep;
+	for (const attachment& a : attachments) {
+		if (a.vertex < 0) continue;
+		glm::vec3 p = a.from + s * (a.to - a.from);
+		glm::vec3 v = (a.to - a.from) / total_dt;
+		if (soa) {
+			px[a.vertex] = p.x; py[a.vertex] = p.y; pz[a.vertex] = p.z;
+			vx[a.vertex] = v.x; vy[a.vertex] = v.y; vz[a.vertex] = v.z;
+		}
+		else {
+			pos[a.vertex] = p;
+			vel[a.vertex] = v;
+		}
+	}
+}
+
+// called at the start of an update: every attached vertex starts from where the last one left it
+void Cloth::start_attached() {
+	for (attachment& a : attachments) {
+		if (a.vertex >= 0) a.from = pos[a.vertex];
+	}
+}
@@ -0,0 +1,86 @@
+// Render mesh finer than the simulated grid
+// on a regular grid the limit surface of Catmull-Clark subdivision is the uniform bicubic B-spline surface
+// of the grid, so every render vertex is evaluated on it directly, with its tangents for a smooth normal
+// the border uses a phantom point 2 p0 - p1 beyond the last vertex, so the surface ends on the border
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+// weights of the four grid vertices around every render vertex along one side of n vertices
+void Cloth::refine_side(int n, vector<refine_taps>& taps) const {
+	int fine = (n - 1) * refine + 1;
+	taps.resize(fine);
+	for (int f = 0; f < fine; f++) {
+		int s = glm::min(f / refine, n - 2); // segment from vertex s to s + 1
+		float t = (f - s * refine) / float(refine);
+		float u = 1.0f - t;
+		refine_taps& tp = taps[f];
+		tp.w[0] = u * u * u / 6.0f; // uniform cubic B-spline basis
+		tp.w[1] = (3.0f * t * t * t - 6.0f * t * t + 4.0f) / 6.0f;
+		tp.w[2] = (-3.0f * t * t * t + 3.0f * t * t + 3.0f * t + 1.0f) / 6.0f;
+		tp.w[3] = t * t * t / 6.0f;
+		tp.dw[0] = -u * u / 2.0f; // its derivative
+		tp.dw[1] = (3.0f * t * t - 4.0f * t) / 2.0f;
+		tp.dw[2] = (-3.0f * t * t + 2.0f * t + 1.0f) / 2.0f;
+		tp.dw[3] = t * t / 2.0f;
+		for (int m = 0; m < 4; m++) tp.index[m] = s - 1 + m;
+
+		// fold the phantom points into the vertices they are made of
+		if (tp.index[0] < 0) {
+			tp.w[1] += 2.0f * tp.w[0]; tp.w[2] -= tp.w[0];
+			tp.dw[1] += 2.0f * tp.dw[0]; tp.dw[2] -= tp.dw[0];
+			tp.w[0] = tp.dw[0] = 0.0f;
+			tp.index[0] = 0;
+		}
+		if (tp.index[3] > n - 1) {
+			tp.w[2] += 2.0f * tp.w[3]; tp.w[1] -= tp.w[3];
+			tp.dw[2] += 2.0f * tp.dw[3]; tp.dw[1] -= tp.dw[3];
+			tp.w[3] = tp.dw[3] = 0.0f;
+			tp.index[3] = n - 1;
+		}
+	}
+}
+
+void Cloth::set_refinement(int r) {
+	refine = glm::max(1, r);
+	refine_side(length, refine_i);
+	refine_side(width, refine_j);
+}
+
+int Cloth::render_length() const {
+	return (length - 1) * refine + 1;
+}
+
+int Cloth::render_width() const {
+	return (width - 1) * refine + 1;
+}
+
+// every render vertex only reads the grid, so the rows run in parallel and each float of out is written once
+void Cloth::write_refined(float* out) const {
+	int fl = render_length(), fw = render_width();
+	#pragma omp parallel for
+	for (int fi = 0; fi < fl; fi++) {
+		const refine_taps& ti = refine_i[fi];
+		for (int fj = 0; fj < fw; fj++) {
+			const refine_taps& tj = refine_j[fj];
+			glm::vec3 p(0.0f), du(0.0f), dv(0.0f); // position and tangents along i and j
+			for (int a = 0; a < 4; a++) {
+				const glm::vec3* row = &pos[ti.index[a] * width];
+				glm::vec3 r(0.0f), dr(0.0f);
+				for (int b = 0; b < 4; b++) {
+					r += tj.w[b] * row[tj.index[b]];
+					dr += tj.dw[b] * row[tj.index[b]];
+				}
+				p += ti.w[a] * r;
+				du += ti.dw[a] * r;
+				dv += ti.w[a] * dr;
+			}
+			glm::vec3 n = glm::cross(dv, du); // same side as the triangle normals of the grid
+			float len = glm::length(n);
+			if (len > 0.0f) n /= len;
+			float* v = out + 6 * (fi * fw + fj);
+			v[0] = p.x; v[1] = p.y; v[2] = p.z;
+			v[3] = n.x; v[4] = n.y; v[5] = n.z;
+		}
+	}
+}
@@ -23,6 +23,8 @@
 #include "../../Tools/FileLoader.h"
 #include "../../Tools/UserControl.h"
 #include "Cloth.h"
+#include "ClothBench.h"
+#include "../../ParticleSystems/Source/ParticleSystem.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../../stb_image.h"
@@ -40,8 +42,6 @@ GLint uniModel, uniView, uniProj, uniColor;
 
 // cloth specs
 Cloth cloth;
-vector<float> vertices;
-vector<float> normals;
 vector<int> indices;
 
 // sphere data
@@ -60,23 +60,36 @@ float relative_dis, relativeX, relativeY;
 glm::vec3 wind_dir;
 float windspeed;
 
+// water hose, its particles hit the cloth and push it
+ParticleSystem spray;
+const int spray_max = 20000; // most particles alive at once
+bool spraying;
+
 GLuint shaderProgram;
 GLuint uvshaderProgram;
 void init();
 void update(float dt, GLuint vbo[], GLuint vbo_sph[]);
 void draw_cloth();
 void draw_sphere();
+void draw_spray();
 void set_camera();
 void set_wind(SDL_Event event, Cloth &cloth);
 GLuint load_texture(const char* filePath);
 
-GLuint vao_cloth, vao_sph;
+GLuint vao_cloth, vao_sph, vao_spray;
 GLuint texture;
 
 bool play = false;
 
 int main(int argc, char* args[]) {
 
+    // "-bench [frames] [grid size] [shear k] [bending k]" times the solvers without opening a window
+    if (argc > 1 && string(args[1]) == "-bench") {
+        run_benchmark(argc > 2 ? atoi(args[2]) : 200, argc > 3 ? atoi(args[3]) : 30,
+            argc > 4 ? float(atof(args[4])) : 0.0f, argc > 5 ? float(atof(args[5])) : 0.0f);
+        return 0;
+    }
+
     //======================= Initializations and Window Setup =================================
     init();
 
@@ -158,8 +171,8 @@ int main(int argc, char* args[]) {
     glBindVertexArray(vao_sph); //Bind the sphere VAO to the current context
 
     //Allocate memory on the graphics card to store geometry (vertex buffer object)
-    GLuint vbo_cloth[3], vbo_sph[2];
-    glGenBuffers(3, vbo_cloth);
+    GLuint vbo_cloth[2], vbo_sph[2];
+    glGenBuffers(2, vbo_cloth);
     glGenBuffers(2, vbo_sph);
 
 
@@ -181,19 +194,42 @@ int main(int argc, char* args[]) {
     glBindVertexArray(vao_cloth); //Bind the cloth VAO to the current context
 
     vector<float> uvs = cloth.get_uv();
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_cloth[2]); //Set the vbo as the active array buffer (Only one buffer can be active at a time)
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_cloth[1]); //Set the vbo as the active array buffer (Only one buffer can be active at a time)
     glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(float), &uvs[0], GL_STATIC_DRAW); //upload vertices to vbo
 
     GLint uvAttrib = glGetAttribLocation(uvshaderProgram, "inUV");
     glVertexAttribPointer(uvAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(uvAttrib);
 
+    // positions & normals of the cloth, interleaved, the cloth writes them into the mapped buffer every frame
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_cloth[0]);
+    glBufferData(GL_ARRAY_BUFFER, cloth.render_floats() * sizeof(float), NULL, GL_STREAM_DRAW);
+
+    GLint clothPosAttrib = glGetAttribLocation(uvshaderProgram, "position");
+    glVertexAttribPointer(clothPosAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
+    glEnableVertexAttribArray(clothPosAttrib);
+
+    GLint clothNormalAttrib = glGetAttribLocation(uvshaderProgram, "inNormal");
+    glVertexAttribPointer(clothNormalAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(clothNormalAttrib);
+
     GLuint ebo; // Element buffer object
     glGenBuffers(1, &ebo);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STREAM_DRAW);
 
+    // positions of the water particles, drawn as points with a fixed normal
+    glGenVertexArrays(1, &vao_spray);
+    glBindVertexArray(vao_spray);
+    GLuint vbo_spray;
+    glGenBuffers(1, &vbo_spray);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_spray);
+    glBufferData(GL_ARRAY_BUFFER, spray_max * 3 * sizeof(float), NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(posAttrib);
+    glVertexAttrib3f(normalAttrib, 0.0f, 1.0f, 1.0f); // facing the light
+
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
 
@@ -210,6 +246,10 @@ int main(int argc, char* args[]) {
                 quit = true; //Exit event loop
             if (windowEvent.type == SDL_KEYUP && windowEvent.key.keysym.sym == SDLK_SPACE)
                 play = true; //play
+            if (windowEvent.type == SDL_KEYUP && windowEvent.key.keysym.sym == SDLK_h) { // turn the hose on and off
+                spraying = !spraying;
+                spray.set_gen(spraying);
+            }
 
             set_wind(windowEvent, cloth);
 
@@ -228,6 +268,16 @@ int main(int argc, char* args[]) {
 
         update(0.035, vbo_cloth, vbo_sph);
 
+        glBindVertexArray(vao_spray);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_spray);
+        int spray_bytes = spray.count() * 3 * sizeof(float); // the positions are x/y/z arrays, interleave them into the buffer
+        float* spray_mapped = spray_bytes ? (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, spray_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT) : NULL;
+        if (spray_mapped) {
+            spray.write_pos(spray_mapped);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        draw_spray();
+
         //printf("FPS: %i \n", int(1 / dt));
 
         SDL_GL_SwapWindow(window); //Double buffering
@@ -239,10 +289,12 @@ int main(int argc, char* args[]) {
     glDeleteShader(vertexShader);
 
     glDeleteBuffers(1, &ebo);
-    glDeleteBuffers(1, vbo_cloth);
+    glDeleteBuffers(2, vbo_cloth);
     glDeleteBuffers(1, vbo_sph);
+    glDeleteBuffers(1, &vbo_spray);
     glDeleteVertexArrays(1, &vao_cloth);
     glDeleteVertexArrays(1, &vao_sph);
+    glDeleteVertexArrays(1, &vao_spray);
 
     SDL_GL_DeleteContext(context);
     SDL_Quit();
@@ -257,7 +309,12 @@ void init() {
     look_at = glm::vec3(0.0f, 0.0f, 5.0f);
     up = glm::vec3(0.0f, 0.0f, 1.0f);
 
-    cloth = Cloth(30, 30, -20.0f, 0.5f, 1.0f, 15000.0f, 800.0f);
+    cloth = Cloth(30, 30, -20.0f, 0.5f, 1.0f, 1000.0f, 200.0f); // soft strings, strain limiting keeps them from stretching
+    cloth.set_strain_limit(0.05f, 2);
+    cloth.set_adaptive(true, 1); // update() takes as many substeps as needed, up to 70
+    cloth.set_sleeping(true, 1.0f, 10.0f, 20); // tiles that stay still for 20 frames stop being simulated
+    cloth.set_refinement(3); // drawn with 3x3 smooth quads per simulated quad
+    cloth.set_turbulence(0.4f, 5.0f, 0.5f, 8); // gusts of 40% of the wind speed, 5 units across
     indices = cloth.get_index();
 
     sph_loc = glm::vec3(0.0f, 10.0f, 10.0f);
@@ -268,13 +325,23 @@ void init() {
 
     wind_dir = glm::vec3(0.0f);
     windspeed = 0.0f;
+
+    // aimed at the cloth past the sphere, off until "H" is pressed
+    spray = ParticleSystem(5000, 2.0f, 0.0f, spray_max, glm::vec3(3.0f, 12.0f, 7.0f), 0.5f, src_type::dim2, axis::Y, -15.0f, 5.0f, glm::vec3(0.4f, 0.9f, 1.0f));
+    spraying = false;
+    spray.set_gen(false);
 }
 
 void update(float dt, GLuint vbo[], GLuint vbo_sph[]) {
     
-    if (play) cloth.update(dt, 70, sph_loc, sph_rad);
-    vertices = cloth.vertex_buffer();
-    normals = cloth.get_normal();
+    if (play) {
+        cloth.update(dt, 70, sph_loc, sph_rad);
+        spray.update(dt, ParticleSystem::particle_type::fluid, sph_loc, sph_rad);
+        // the water pushes the cloth and runs off it
+        cloth.collide_particles(spray.count(), spray.start_array(axis::X), spray.start_array(axis::Y), spray.start_array(axis::Z),
+            spray.pos_array(axis::X), spray.pos_array(axis::Y), spray.pos_array(axis::Z),
+            spray.vel_array(axis::X), spray.vel_array(axis::Y), spray.vel_array(axis::Z), 0.01f, 0.05f);
+    }
 
     if (grabbed) {
         sph_loc = glm::normalize(look_at - cam_loc);
@@ -290,17 +357,13 @@ void update(float dt, GLuint vbo[], GLuint vbo_sph[]) {
 
     glBindVertexArray(vao_cloth);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]); // vertex positions
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STREAM_DRAW);
-    GLint posAttrib = glGetAttribLocation(uvshaderProgram, "position");
-    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(posAttrib);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]); // vertex normals
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), &normals[0], GL_STREAM_DRAW);
-    GLint normalAttrib = glGetAttribLocation(uvshaderProgram, "inNormal");
-    glVertexAttribPointer(normalAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(normalAttrib);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]); // vertex positions & normals, no copy on the CPU side
+    int render_bytes = cloth.render_floats() * sizeof(float);
+    float* mapped = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, render_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped) {
+        cloth.write_render(mapped);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
 
     glUseProgram(uvshaderProgram);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -340,6 +403,14 @@ void draw_sphere() {
     glDrawArrays(GL_TRIANGLES, 0, sph_vert / 3); //(Primitives, starting index, Number of vertices)
 }
 
+void draw_spray() {
+    glm::mat4 model = glm::mat4();
+    glUniformMatrix4fv(uniModel, 1, GL_FALSE, glm::value_ptr(model));
+    glUniform3f(uniColor, 0.4f, 0.9f, 1.0f);
+    glPointSize(3.0f);
+    glDrawArrays(GL_POINTS, 0, spray.count()); //(Primitives, starting index, Number of vertices)
+}
+
 void set_camera() {
     //Set the Camera view paramters (FOV, aspect ratio, etc.)
     glm::mat4 proj = glm::perspective(3.14f / 4, aspect, .1f, 1000.0f); //FOV, aspect, near, far
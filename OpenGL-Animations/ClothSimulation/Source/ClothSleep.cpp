@@ -0,0 +1,158 @@
+// Sleeping tiles for the explicit solver
+// the cloth is cut into tile_size x tile_size tiles of vertices, and a tile that stays still for a few
+// frames is put to sleep: its vertices keep their position, their velocity is zeroed, and every spring,
+// drag and integration loop skips them until something comes close enough to wake them up
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+namespace {
+
+	// whether a box gets within reach of the sphere on its way from obs_from to obs_to
+	// (the box around the swept sphere, so it errs on the side of waking)
+	bool near_obstacle(const glm::vec3& lo, const glm::vec3& hi, glm::vec3 obs_from, glm::vec3 obs_to, float reach) {
+		glm::vec3 olo = glm::min(obs_from, obs_to) - glm::vec3(reach);
+		glm::vec3 ohi = glm::max(obs_from, obs_to) + glm::vec3(reach);
+		return lo.x <= ohi.x && olo.x <= hi.x && lo.y <= ohi.y && olo.y <= hi.y && lo.z <= ohi.z && olo.z <= hi.z;
+	}
+}
+
+void Cloth::init_sleep() {
+	static_assert(tile_size % simd::lanes == 0, "a SIMD chunk of a row must never straddle two tiles");
+	tiles_l = (length + tile_size - 1) / tile_size;
+	tiles_w = (width + tile_size - 1) / tile_size;
+	int nt = tiles_l * tiles_w;
+	tile_awake.assign(nt, 1);
+	tile_quiet.assign(nt, 0);
+	tile_box_lo.assign(nt, glm::vec3(0.0f));
+	tile_box_hi.assign(nt, glm::vec3(0.0f));
+	active.assign(length * width, 1);
+	frame_vel.assign(length * width, glm::vec3(0.0f));
+	active_tiles = nt;
+}
+
+void Cloth::set_sleeping(bool on, float energy, float force, int frames) {
+	sleeping = on;
+	sleep_energy = energy;
+	sleep_force = force;
+	sleep_frames = glm::max(1, frames);
+	wake_all();
+}
+
+float Cloth::active_fraction() const {
+	return active_tiles / float(tiles_l * tiles_w);
+}
+
+void Cloth::wake_all() {
+	int nt = tiles_l * tiles_w;
+	for (int t = 0; t < nt; t++) {
+		tile_awake[t] = 1;
+		tile_quiet[t] = 0;
+	}
+	refresh_active();
+}
+
+// copy the tile flags to every vertex, so the solver loops need a single lookup
+void Cloth::refresh_active() {
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) active[i * width + j] = tile_awake[(i / tile_size) * tiles_w + j / tile_size];
+	}
+	active_tiles = 0;
+	for (int t = 0; t < tiles_l * tiles_w; t++) active_tiles += tile_awake[t];
+}
+
+// called before the substeps: sleeping tiles the sphere may reach during this frame wake up
+void Cloth::wake_tiles(glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad) {
+	float reach = obs_rad + 0.2f + restlen; // the collision radius and a string of slack
+	bool changed = false;
+	for (int t = 0; t < tiles_l * tiles_w; t++) {
+		if (tile_awake[t]) continue;
+		if (near_obstacle(tile_box_lo[t], tile_box_hi[t], obs_from, obs_loc, reach)) {
+			tile_awake[t] = 1;
+			tile_quiet[t] = 0;
+			changed = true;
+		}
+	}
+	if (changed) refresh_active();
+
+	// velocities at the start of the frame, for the force residual in sleep_tiles()
+	int n = length * width;
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) frame_vel[i] = vel[i];
+}
+
+// called after the substeps
+// an awake tile whose kinetic energy and largest net force (m |dv| / dt over the frame) stayed below the
+// thresholds for sleep_frames frames falls asleep, a sleeping tile wakes when a moving tile is next to it,
+// or when a vertex of it got a velocity from anything but the solver (e.g. self-collision)
+// a tile within reach of the sphere stays awake, or wake_tiles() would wake it again right away
+void Cloth::sleep_tiles(float total_dt, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad) {
+	#pragma omp parallel for
+	for (int t = 0; t < tiles_l * tiles_w; t++) {
+		int i0 = (t / tiles_w) * tile_size, j0 = (t % tiles_w) * tile_size;
+		int i1 = glm::min(i0 + tile_size, length), j1 = glm::min(j0 + tile_size, width);
+		float energy = 0.0f, force = 0.0f;
+		for (int i = i0; i < i1; i++) {
+			for (int j = j0; j < j1; j++) {
+				int ind = i * width + j;
+				energy += 0.5f * vertex_mass[ind] * glm::dot(vel[ind], vel[ind]);
+				force = glm::max(force, vertex_mass[ind] / total_dt * glm::length(vel[ind] - frame_vel[ind]));
+			}
+		}
+		if (!tile_awake[t]) {
+			if (energy > 0.0f) tile_quiet[t] = -1; // woken from outside, handled below
+			continue;
+		}
+		if (energy > sleep_energy || force > sleep_force) {
+			tile_quiet[t] = 0;
+			continue;
+		}
+		tile_quiet[t]++;
+	}
+
+	// the flags of the neighbours are read, so the decisions are made in a second pass
+	// a tile counts as moving when it is awake and was not quiet this frame, which no decision below changes
+	bool changed = false;
+	for (int t = 0; t < tiles_l * tiles_w; t++) {
+		bool moving_neighbour = false;
+		int ti = t / tiles_w, tj = t % tiles_w;
+		for (int a = glm::max(ti - 1, 0); a <= glm::min(ti + 1, tiles_l - 1); a++) {
+			for (int b = glm::max(tj - 1, 0); b <= glm::min(tj + 1, tiles_w - 1); b++) {
+				int nb = a * tiles_w + b;
+				if (nb != t && tile_awake[nb] && tile_quiet[nb] == 0) moving_neighbour = true;
+			}
+		}
+
+		if (!tile_awake[t]) {
+			if (tile_quiet[t] < 0 || moving_neighbour) {
+				tile_awake[t] = 1;
+				tile_quiet[t] = 1; // its vertices are at rest, so it does not count as moving yet
+				changed = true;
+			}
+			continue;
+		}
+		if (tile_quiet[t] < sleep_frames || moving_neighbour) continue;
+
+		int i0 = ti * tile_size, j0 = tj * tile_size;
+		int i1 = glm::min(i0 + tile_size, length), j1 = glm::min(j0 + tile_size, width);
+		glm::vec3 lo(1e30f), hi(-1e30f);
+		for (int i = i0; i < i1; i++) {
+			for (int j = j0; j < j1; j++) {
+				lo = glm::min(lo, pos[i * width + j]);
+				hi = glm::max(hi, pos[i * width + j]);
+			}
+		}
+		if (near_obstacle(lo, hi, obs_from, obs_loc, obs_rad + 0.2f + restlen)) continue;
+
+		// fall asleep
+		tile_awake[t] = 0;
+		changed = true;
+		for (int i = i0; i < i1; i++) {
+			for (int j = j0; j < j1; j++) vel[i * width + j] = glm::vec3(0.0f);
+		}
+		tile_box_lo[t] = lo;
+		tile_box_hi[t] = hi;
+	}
+	if (changed) refresh_active();
+}
@@ -0,0 +1,246 @@
+// Structure-of-arrays solver for the string-based cloth
+// the spring and integration stages run on separate x/y/z arrays with the kernels below,
+// which are vectorized through SIMD.h (AVX2 / NEON) and fall back to plain floats
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+namespace {
+
+	// raw pointers into the arrays of one cloth
+	struct soa_arrays {
+		float *px, *py, *pz; // positions
+		float *vx, *vy, *vz; // velocities
+		float *vfx, *vfy, *vfz; // vertical string forces (zero padded)
+		float *hfx, *hfy, *hfz; // horizontal string forces (zero padded)
+		float *gfx, *gfy, *gfz; // drag forces
+		float *inv_mass; // 1 / mass, 0 for pins
+		float *free_mask; // 0 for pins
+	};
+
+	// force in the string from vertex a to vertex b, stored to slot o of (fx, fy, fz)
+	template<class V>
+	inline void string_kernel(const soa_arrays& s, int a, int b, float* fx, float* fy, float* fz, int o, float k, float kv, float restlen) {
+		V dx = simd::sub(simd::load<V>(s.px + b), simd::load<V>(s.px + a));
+		V dy = simd::sub(simd::load<V>(s.py + b), simd::load<V>(s.py + a));
+		V dz = simd::sub(simd::load<V>(s.pz + b), simd::load<V>(s.pz + a));
+		V len = simd::sqrt(simd::madd(dx, dx, simd::madd(dy, dy, simd::mul(dz, dz)))); // distance between two conjunctions
+		V stringF = simd::mul(simd::set1<V>(-k), simd::sub(len, simd::set1<V>(restlen))); // elastic force in the string
+
+		dx = simd::div(dx, len); // (dx, dy, dz) is now the unit direction
+		dy = simd::div(dy, len);
+		dz = simd::div(dz, len);
+		V dvx = simd::sub(simd::load<V>(s.vx + a), simd::load<V>(s.vx + b));
+		V dvy = simd::sub(simd::load<V>(s.vy + a), simd::load<V>(s.vy + b));
+		V dvz = simd::sub(simd::load<V>(s.vz + a), simd::load<V>(s.vz + b));
+		V dampF = simd::mul(simd::set1<V>(kv), simd::madd(dvx, dx, simd::madd(dvy, dy, simd::mul(dvz, dz)))); // damping force in the string
+
+		V f = simd::add(stringF, dampF);
+		simd::store(fx + o, simd::mul(f, dx));
+		simd::store(fy + o, simd::mul(f, dy));
+		simd::store(fz + o, simd::mul(f, dz));
+	}
+
+	// explicit Euler step of vertex ind
+	// vu/vl are the slots of its upper/lower vertical strings, hl/hr of its left/right horizontal strings
+	template<class V>
+	inline void euler_kernel(const soa_arrays& s, int ind, int vu, int hl, V gravity, V dt, int width) {
+		int vl = vu + 1;
+		int hr = hl + width;
+		V fx = simd::add(simd::sub(simd::load<V>(s.vfx + vu), simd::load<V>(s.vfx + vl)), simd::sub(simd::load<V>(s.hfx + hl), simd::load<V>(s.hfx + hr)));
+		V fy = simd::add(simd::sub(simd::load<V>(s.vfy + vu), simd::load<V>(s.vfy + vl)), simd::sub(simd::load<V>(s.hfy + hl), simd::load<V>(s.hfy + hr)));
+		V fz = simd::add(simd::sub(simd::load<V>(s.vfz + vu), simd::load<V>(s.vfz + vl)), simd::sub(simd::load<V>(s.hfz + hl), simd::load<V>(s.hfz + hr)));
+
+		// (string force / 2 + drag) / mass + gravity, the same scaling as the vec3 solver
+		V half = simd::set1<V>(0.5f);
+		V w = simd::load<V>(s.inv_mass + ind);
+		V ax = simd::mul(simd::madd(fx, half, simd::load<V>(s.gfx + ind)), w);
+		V ay = simd::mul(simd::madd(fy, half, simd::load<V>(s.gfy + ind)), w);
+		V az = simd::madd(simd::madd(fz, half, simd::load<V>(s.gfz + ind)), w, gravity);
+
+		// pins have a zero mask, so their velocity stays zero and they never move
+		V mask = simd::load<V>(s.free_mask + ind);
+		V vx = simd::mul(simd::madd(ax, dt, simd::load<V>(s.vx + ind)), mask);
+		V vy = simd::mul(simd::madd(ay, dt, simd::load<V>(s.vy + ind)), mask);
+		V vz = simd::mul(simd::madd(az, dt, simd::load<V>(s.vz + ind)), mask);
+		simd::store(s.vx + ind, vx);
+		simd::store(s.vy + ind, vy);
+		simd::store(s.vz + ind, vz);
+		simd::store(s.px + ind, simd::madd(vx, dt, simd::load<V>(s.px + ind)));
+		simd::store(s.py + ind, simd::madd(vy, dt, simd::load<V>(s.py + ind)));
+		simd::store(s.pz + ind, simd::madd(vz, dt, simd::load<V>(s.pz + ind)));
+	}
+}
+
+void Cloth::init_soa() {
+	int n = length * width;
+	simd::aligned_floats* vertex_arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &gfx, &gfy, &gfz };
+	for (simd::aligned_floats* a : vertex_arrays) a->assign(n, 0.0f);
+
+	// the padding slots stay zero forever, so the end of a row needs no special case
+	vfx.assign(length * (width + 1), 0.0f);
+	vfy.assign(length * (width + 1), 0.0f);
+	vfz.assign(length * (width + 1), 0.0f);
+	hfx.assign((length + 1) * width, 0.0f);
+	hfy.assign((length + 1) * width, 0.0f);
+	hfz.assign((length + 1) * width, 0.0f);
+}
+
+void Cloth::update_soa(float total_dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad) {
+
+	int n = length * width;
+	float dt = total_dt / substep;
+
+	// gather the state into the separate arrays
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		px[i] = pos[i].x; py[i] = pos[i].y; pz[i] = pos[i].z;
+		vx[i] = vel[i].x; vy[i] = vel[i].y; vz[i] = vel[i].z;
+	}
+
+	for (int step = 0; step < substep; step++) {
+		spring_forces_soa();
+		advance_wind(dt, true);
+		drag_soa();
+		spring_batch_forces_soa();
+		integrate_soa(dt, obs_at(obs_from, obs_loc, step, substep), obs_at(obs_from, obs_loc, step + 1, substep), obs_rad);
+		move_attached(step, substep, total_dt, true);
+		limit_strain(true);
+	}
+
+	// write the state back so the rest of the class sees it
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		pos[i] = glm::vec3(px[i], py[i], pz[i]);
+		vel[i] = glm::vec3(vx[i], vy[i], vz[i]);
+	}
+}
+
+void Cloth::spring_forces_soa() {
+	soa_arrays s = { px.data(), py.data(), pz.data(), vx.data(), vy.data(), vz.data(),
+		vfx.data(), vfy.data(), vfz.data(), hfx.data(), hfy.data(), hfz.data(),
+		gfx.data(), gfy.data(), gfz.data(), inv_mass.data(), free_mask.data() };
+
+	// vertical, the string between (i, j) and (i, j + 1) goes to slot i * (width + 1) + j + 1
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		int base = i * width;
+		int out = i * (width + 1) + 1;
+		int j = 0;
+		// a chunk lies in one tile, its strings end in the same tile or at the first vertex of the next one
+		for (; j + simd::lanes <= width - 1; j += simd::lanes) {
+			if (!active[base + j] && !active[base + j + simd::lanes]) continue; // sleeping
+			string_kernel<simd::vfloat>(s, base + j, base + j + 1, s.vfx, s.vfy, s.vfz, out + j, k, kv, restlen);
+		}
+		for (; j < width - 1; j++) {
+			if (!active[base + j] && !active[base + j + 1]) continue;
+			string_kernel<float>(s, base + j, base + j + 1, s.vfx, s.vfy, s.vfz, out + j, k, kv, restlen);
+		}
+	}
+
+	// horizontal, the string between (i, j) and (i + 1, j) goes to slot (i + 1) * width + j
+	#pragma omp parallel for
+	for (int i = 0; i < length - 1; i++) {
+		int base = i * width;
+		int out = (i + 1) * width;
+		int j = 0;
+		for (; j + simd::lanes <= width; j += simd::lanes) {
+			if (!active[base + j] && !active[base + width + j]) continue; // sleeping
+			string_kernel<simd::vfloat>(s, base + j, base + width + j, s.hfx, s.hfy, s.hfz, out + j, k, kv, restlen);
+		}
+		for (; j < width; j++) {
+			if (!active[base + j] && !active[base + width + j]) continue;
+			string_kernel<float>(s, base + j, base + width + j, s.hfx, s.hfy, s.hfz, out + j, k, kv, restlen);
+		}
+	}
+}
+
+void Cloth::integrate_soa(float dt, glm::vec3 obs_from, glm::vec3 obs_to, float obs_rad) {
+	soa_arrays s = { px.data(), py.data(), pz.data(), vx.data(), vy.data(), vz.data(),
+		vfx.data(), vfy.data(), vfz.data(), hfx.data(), hfy.data(), hfz.data(),
+		gfx.data(), gfy.data(), gfz.data(), inv_mass.data(), free_mask.data() };
+
+	float near = obs_rad + 0.1f + glm::length(obs_to - obs_from);
+	float near2 = 2.0f * near * near;
+
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		int base = i * width;
+		int vrow = i * (width + 1);
+		int j = 0;
+		for (; j + simd::lanes <= width; j += simd::lanes) {
+			if (!active[base + j]) continue; // sleeping, the whole chunk lies in one tile
+			euler_kernel<simd::vfloat>(s, base + j, vrow + j, base + j, simd::set1<simd::vfloat>(gravity), simd::set1<simd::vfloat>(dt), width);
+		}
+		for (; j < width; j++) {
+			if (!active[base + j]) continue;
+			euler_kernel<float>(s, base + j, vrow + j, base + j, gravity, dt, width);
+		}
+
+		// collision detection, scalar
+		for (j = 0; j < width; j++) {
+			int ind = base + j;
+			if (free_mask[ind] == 0.0f || !active[ind]) continue; // exclude the pins and sleeping vertices
+			glm::vec3 p(px[ind], py[ind], pz[ind]), v(vx[ind], vy[ind], vz[ind]);
+			glm::vec3 rel = p - obs_to;
+			bool hit = false;
+			if (glm::dot(rel, rel) <= near2 + 2.0f * dt * dt * glm::dot(v, v)) // (a + b)^2 <= 2 a^2 + 2 b^2 bounds the reach of both motions
+				hit = cloth_kernels::sweep_sphere<float>(p, v, p - v * dt, obs_from, obs_to, obs_rad, dt); // the kernel moved the vertex by v * dt
+			if (!colliders.empty()) {
+				collide_meshes(p, v);
+				hit = true;
+			}
+			if (!hit) continue;
+			px[ind] = p.x; py[ind] = p.y; pz[ind] = p.z;
+			vx[ind] = v.x; vy[ind] = v.y; vz[ind] = v.z;
+		}
+	}
+}
+
+// shear and bending springs, batch by batch
+// they share the drag arrays, so their force is halved here to match the string scaling
+void Cloth::spring_batch_forces_soa() {
+	for (int b = extra_batch; b < batch_start.size() - 1; b++) {
+		#pragma omp parallel for
+		for (int c = batch_start[b]; c < batch_start[b + 1]; c++) {
+			const spring& s = springs[c];
+			if (!active[s.a] && !active[s.b]) continue; // between two sleeping vertices
+			glm::vec3 d(px[s.b] - px[s.a], py[s.b] - py[s.a], pz[s.b] - pz[s.a]);
+			float len = glm::length(d);
+			d /= len;
+			float stringF = -s.k * (len - s.rest);
+			float dampF = s.kv * ((vx[s.a] - vx[s.b]) * d.x + (vy[s.a] - vy[s.b]) * d.y + (vz[s.a] - vz[s.b]) * d.z);
+			glm::vec3 f = 0.5f * (stringF + dampF) * d;
+			gfx[s.a] -= f.x; gfy[s.a] -= f.y; gfz[s.a] -= f.z;
+			gfx[s.b] += f.x; gfy[s.b] += f.y; gfz[s.b] += f.z;
+		}
+	}
+}
+
+// same as drag() but reading the separate arrays
+void Cloth::drag_soa() {
+	#pragma omp parallel for
+	for (int i = 0; i < length - 1; i++) {
+		for (int j = 0; j < width - 1; j++) {
+			int ind[4] = { i * width + j, i * width + j + 1, (i + 1) * width + j + 1, (i + 1) * width + j };
+			if (!(active[ind[0]] || active[ind[1]] || active[ind[2]] || active[ind[3]])) continue; // sleeping quad
+			glm::vec3 pc[4], vc[4];
+			for (int m = 0; m < 4; m++) {
+				pc[m] = glm::vec3(px[ind[m]], py[ind[m]], pz[ind[m]]);
+				vc[m] = glm::vec3(vx[ind[m]], vy[ind[m]], vz[ind[m]]);
+			}
+			const glm::vec3* p[4] = { &pc[0], &pc[1], &pc[2], &pc[3] };
+			const glm::vec3* v[4] = { &vc[0], &vc[1], &vc[2], &vc[3] };
+			quad_drag(i * (width - 1) + j, p, v);
+		}
+	}
+
+	#pragma omp parallel for
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) {
+			glm::vec3 f = gather_triangles(tforce, i, j);
+			int ind = i * width + j;
+			gfx[ind] = f.x; gfy[ind] = f.y; gfz[ind] = f.z;
+		}
+	}
+}
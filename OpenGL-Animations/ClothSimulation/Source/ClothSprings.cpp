@@ -0,0 +1,135 @@
+// The spring list of the string-based cloth
+// structural, shear and bending springs are stored in colour batches:
+// no two springs in a batch share a vertex, so each batch can be processed in parallel
+// and scattered into the vertices without atomics
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+void Cloth::init_springs() {
+	springs.clear();
+	batch_start.clear();
+
+	// structural strings, the same ones the grid kernels handle
+	vector<spring> group;
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) {
+			if (j < width - 1) group.push_back(make_spring(i * width + j, i * width + j + 1, k, kv));
+			if (i < length - 1) group.push_back(make_spring(i * width + j, (i + 1) * width + j, k, kv));
+		}
+	}
+	add_batches(group);
+	extra_batch = batch_start.size();
+
+	// shear (diagonal) and bending (skip-one) springs
+	group.clear();
+	float kv_shear = spring_damping(k_shear), kv_bend = spring_damping(k_bend);
+	for (int i = 0; i < length; i++) {
+		for (int j = 0; j < width; j++) {
+			if (k_shear > 0.0f && i < length - 1 && j < width - 1) {
+				group.push_back(make_spring(i * width + j, (i + 1) * width + j + 1, k_shear, kv_shear));
+				group.push_back(make_spring(i * width + j + 1, (i + 1) * width + j, k_shear, kv_shear));
+			}
+			if (k_bend > 0.0f && j < width - 2) group.push_back(make_spring(i * width + j, i * width + j + 2, k_bend, kv_bend));
+			if (k_bend > 0.0f && i < length - 2) group.push_back(make_spring(i * width + j, (i + 2) * width + j, k_bend, kv_bend));
+		}
+	}
+	add_batches(group);
+	batch_start.push_back(springs.size());
+
+	// vertex to spring adjacency in compressed rows, used to gather the Jacobi corrections
+	int n = length * width;
+	adj_start.assign(n + 1, 0);
+	for (const spring& s : springs) {
+		adj_start[s.a + 1]++;
+		adj_start[s.b + 1]++;
+	}
+	for (int i = 0; i < n; i++) adj_start[i + 1] += adj_start[i];
+	adj_spring.assign(adj_start[n], 0);
+	vector<int> fill(adj_start.begin(), adj_start.end() - 1);
+	for (int c = 0; c < springs.size(); c++) {
+		adj_spring[fill[springs[c].a]++] = c;
+		adj_spring[fill[springs[c].b]++] = c;
+	}
+
+	lambda.assign(springs.size(), 0.0f);
+	spring_dx.assign(springs.size(), glm::vec3(0.0f));
+	sdir.assign(springs.size(), glm::vec3(0.0f));
+	scoef.assign(springs.size(), 0.0f);
+	sforce.assign(n, glm::vec3(0.0f));
+	prev_pos.assign(n, glm::vec3(0.0f));
+}
+
+Cloth::spring Cloth::make_spring(int a, int b, float ks, float kd) const {
+	spring s;
+	s.a = a;
+	s.b = b;
+	int di = b / width - a / width, dj = b % width - a % width;
+	s.rest = restlen * sqrt(float(di * di + dj * dj)); // rest length from the grid spacing
+	s.k = ks;
+	s.kv = kd;
+	return s;
+}
+
+// the damping ratio of the structural strings, or their damping itself when they have no stiffness
+// (e.g. a cloth held together by shear and bending springs only)
+float Cloth::spring_damping(float ks) const {
+	if (ks <= 0.0f) return 0.0f;
+	return k > 0.0f ? kv * ks / k : kv;
+}
+
+// greedy colouring: every spring goes to the first batch that touches neither of its vertices
+// the batches are appended to springs/batch_start in order
+void Cloth::add_batches(const vector<spring>& group) {
+	int n = length * width;
+	vector<int> color(group.size());
+	vector<vector<char> > used; // used[c][v] is set when batch c already touches vertex v
+	for (int s = 0; s < group.size(); s++) {
+		int c = 0;
+		while (c < used.size() && (used[c][group[s].a] || used[c][group[s].b])) c++;
+		if (c == used.size()) used.push_back(vector<char>(n, 0));
+		used[c][group[s].a] = 1;
+		used[c][group[s].b] = 1;
+		color[s] = c;
+	}
+
+	for (int c = 0; c < used.size(); c++) {
+		batch_start.push_back(springs.size());
+		for (int s = 0; s < group.size(); s++) {
+			if (color[s] == c) springs.push_back(group[s]);
+		}
+	}
+}
+
+void Cloth::set_shear_bend(float shear, float bend) {
+	k_shear = shear;
+	k_bend = bend;
+	init_springs();
+}
+
+int Cloth::spring_count() const {
+	return springs.size();
+}
+
+int Cloth::batch_count() const {
+	return batch_start.size() - 1;
+}
+
+// force of the shear and bending springs on every vertex
+// batches run one after another, the springs of a batch in parallel
+void Cloth::spring_batch_forces() {
+	int n = length * width;
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) sforce[i] = glm::vec3(0.0f);
+
+	for (int b = extra_batch; b < batch_start.size() - 1; b++) {
+		#pragma omp parallel for
+		for (int c = batch_start[b]; c < batch_start[b + 1]; c++) {
+			const spring& s = springs[c];
+			if (!active[s.a] && !active[s.b]) continue; // between two sleeping vertices
+			glm::vec3 f = string_force(s.a, s.b, s.k, s.kv, s.rest);
+			sforce[s.a] -= f;
+			sforce[s.b] += f;
+		}
+	}
+}
@@ -0,0 +1,143 @@
+// Strain limiting for the string-based cloth
+// after every substep each structural string longer than (1 + strain_limit) restlen is pulled back to that
+// length and loses the part of its relative velocity that would stretch it further (Provot 1995)
+// the strings are projected batch by batch, so the ones of a batch run in parallel without sharing a vertex
+// projecting strings alone takes dozens of passes to lift a cloth that hangs 30 strings below its pins, so
+// every vertex is first tethered to its nearest pin: it may be no further from it than (1 + strain_limit) times
+// their distance on the rest grid (Kim et al. 2012, "Long Range Attachments"), which a single parallel pass enforces
+// the nearest pins are found again only after the pin list changed, so a substep costs one tether per vertex
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+#include <climits>
+#include <functional>
+#include <queue>
+
+void Cloth::set_strain_limit(float max_stretch, int iterations) {
+	strain_limit = max_stretch;
+	strain_iter = glm::max(1, iterations);
+}
+
+// multi-source Dijkstra over the 8-connected grid from every pin at once: each vertex hands its pin on to the
+// neighbours that are closer to it than to the pin they have, so every vertex ends with its nearest pin
+// (up to the rare ties a grid propagation misses, the tether length below is exact for whichever pin it gets)
+void Cloth::find_tethers() {
+	int n = length * width;
+	tether.assign(n, -1);
+	tether_len.assign(n, 0.0f);
+	tethers_valid = true;
+	if (pins.empty()) return;
+
+	vector<int> best(n, INT_MAX); // squared grid distance to the pin in tether
+	typedef pair<int, int> entry; // squared distance, vertex
+	priority_queue<entry, vector<entry>, greater<entry>> open;
+	for (int a : pins) {
+		tether[a] = a;
+		best[a] = 0;
+		open.push(entry(0, a));
+	}
+	while (!open.empty()) {
+		entry e = open.top();
+		open.pop();
+		int v = e.second;
+		if (e.first != best[v]) continue; // reached again since with a nearer pin
+		int a = tether[v];
+		int i = v / width, j = v % width;
+		for (int di = -1; di <= 1; di++) {
+			for (int dj = -1; dj <= 1; dj++) {
+				int ni = i + di, nj = j + dj;
+				if ((di == 0 && dj == 0) || ni < 0 || ni >= length || nj < 0 || nj >= width) continue;
+				int u = ni * width + nj;
+				int gi = ni - a / width, gj = nj - a % width;
+				int d2 = gi * gi + gj * gj;
+				if (d2 >= best[u]) continue;
+				best[u] = d2;
+				tether[u] = a;
+				open.push(entry(d2, u));
+			}
+		}
+	}
+	for (int v = 0; v < n; v++) tether_len[v] = restlen * sqrt(float(best[v]));
+}
+
+void Cloth::limit_pin_distance(bool soa) {
+	if (!tethers_valid) find_tethers();
+	if (pins.empty()) return;
+	int n = length * width;
+	float grow = 1.0f + strain_limit;
+	#pragma omp parallel for
+	for (int v = 0; v < n; v++) {
+		if (free_mask[v] == 0.0f || !active[v]) continue;
+		int a = tether[v];
+		glm::vec3 p = soa ? glm::vec3(px[v], py[v], pz[v]) : pos[v];
+		glm::vec3 anchor = soa ? glm::vec3(px[a], py[a], pz[a]) : pos[a];
+		float max_len = grow * tether_len[v];
+		glm::vec3 d = p - anchor;
+		float len2 = glm::dot(d, d);
+		if (len2 <= max_len * max_len) continue;
+		glm::vec3 dir = d / sqrt(len2);
+		p = anchor + max_len * dir;
+		glm::vec3 vv = soa ? glm::vec3(vx[v], vy[v], vz[v]) : vel[v];
+		float outward = glm::dot(vv, dir);
+		if (outward > 0.0f) vv -= outward * dir;
+		if (soa) {
+			px[v] = p.x; py[v] = p.y; pz[v] = p.z;
+			vx[v] = vv.x; vy[v] = vv.y; vz[v] = vv.z;
+		}
+		else {
+			pos[v] = p;
+			vel[v] = vv;
+		}
+	}
+}
+
+// the two ends move in proportion to their inverse mass, pins and sleeping vertices do not move at all
+void Cloth::limit_strain(bool soa) {
+	if (strain_limit <= 0.0f) return;
+	float grow = 1.0f + strain_limit;
+	limit_pin_distance(soa);
+	for (int it = 0; it < strain_iter; it++) {
+		for (int b = 0; b < extra_batch; b++) { // the structural strings
+			#pragma omp parallel for
+			for (int c = batch_start[b]; c < batch_start[b + 1]; c++) {
+				const spring& s = springs[c];
+				float wa = active[s.a] ? inv_mass[s.a] : 0.0f;
+				float wb = active[s.b] ? inv_mass[s.b] : 0.0f;
+				if (wa + wb == 0.0f) continue;
+
+				glm::vec3 pa = soa ? glm::vec3(px[s.a], py[s.a], pz[s.a]) : pos[s.a];
+				glm::vec3 pb = soa ? glm::vec3(px[s.b], py[s.b], pz[s.b]) : pos[s.b];
+				glm::vec3 d = pb - pa;
+				float len = glm::length(d);
+				float max_len = s.rest * grow;
+				if (len <= max_len) continue;
+
+				glm::vec3 n = d / len;
+				wa /= wa + wb;
+				wb = 1.0f - wa;
+				pa += (wa * (len - max_len)) * n;
+				pb -= (wb * (len - max_len)) * n;
+
+				glm::vec3 va = soa ? glm::vec3(vx[s.a], vy[s.a], vz[s.a]) : vel[s.a];
+				glm::vec3 vb = soa ? glm::vec3(vx[s.b], vy[s.b], vz[s.b]) : vel[s.b];
+				float separating = glm::dot(vb - va, n);
+				if (separating > 0.0f) {
+					va += (wa * separating) * n;
+					vb -= (wb * separating) * n;
+				}
+
+				if (soa) {
+					px[s.a] = pa.x; py[s.a] = pa.y; pz[s.a] = pa.z;
+					px[s.b] = pb.x; py[s.b] = pb.y; pz[s.b] = pb.z;
+					vx[s.a] = va.x; vy[s.a] = va.y; vz[s.a] = va.z;
+					vx[s.b] = vb.x; vy[s.b] = vb.y; vz[s.b] = vb.z;
+				}
+				else {
+					pos[s.a] = pa; pos[s.b] = pb;
+					vel[s.a] = va; vel[s.b] = vb;
+				}
+			}
+		}
+	}
+}
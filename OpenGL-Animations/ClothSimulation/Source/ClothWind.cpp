@@ -0,0 +1,123 @@
+// Turbulent wind
+// the gusts are a sum of plane waves u = amp cos(k . (x - shift) - omega t + phase) with amp perpendicular to k,
+// so the field has no divergence like the curl of a noise potential, and the mean wind carries them along (shift)
+// the field is sampled at every triangle centre once every wind_interval substeps, in one vectorized pass,
+// and the drag of the substeps in between blends the last two samples
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+#include <cmath>
+#include <random>
+
+void Cloth::init_wind() {
+	int padded = (2 * (length - 1) * (width - 1) + simd::lanes - 1) / simd::lanes * simd::lanes;
+	tcx.assign(padded, 0.0f); tcy.assign(padded, 0.0f); tcz.assign(padded, 0.0f); // the padding stays at the origin
+	wax.assign(padded, 0.0f); way.assign(padded, 0.0f); waz.assign(padded, 0.0f);
+	wbx.assign(padded, 0.0f); wby.assign(padded, 0.0f); wbz.assign(padded, 0.0f);
+	waves.clear();
+	wind_interval = 1;
+	wind_step = -1;
+	wind_time = 0.0;
+	wind_shift = glm::dvec3(0.0);
+	wind_blend = 0.0f;
+}
+
+// waves of length scale, scale / 2 and scale / 4 in random directions, the shorter ones weaker
+// (amplitude ~ k^(-5/6), as the energy spectrum of turbulence falls off with k^(-5/3))
+void Cloth::set_turbulence(float intensity, float scale, float frequency, int interval) {
+	const float pi = 3.14159265f;
+	const int count = 12;
+	waves.clear();
+	wind_interval = glm::max(1, interval);
+	wind_step = -1; // sample again before the next drag
+	if (sleeping) wake_all();
+	if (intensity <= 0.0f) return;
+
+	mt19937 rng(7); // the same gusts every run
+	uniform_real_distribution<float> uni(0.0f, 1.0f);
+	float energy = 0.0f;
+	for (int m = 0; m < count; m++) {
+		int octave = m % 3;
+		float z = 2.0f * uni(rng) - 1.0f, a = 2.0f * pi * uni(rng);
+		glm::vec3 dir(sqrt(1.0f - z * z) * cos(a), sqrt(1.0f - z * z) * sin(a), z);
+		glm::vec3 side(uni(rng) - 0.5f, uni(rng) - 0.5f, uni(rng) - 0.5f);
+		glm::vec3 amp = glm::cross(dir, side);
+		if (glm::length(amp) < 1e-3f) amp = glm::cross(dir, glm::vec3(1.0f, 0.0f, 0.0f)); // side was along dir
+		float weight = pow(2.0f, -octave * 5.0f / 6.0f);
+
+		wind_wave w;
+		w.k = dir * (2.0f * pi * (1 << octave) / scale);
+		w.amp = glm::normalize(amp) * weight;
+		w.phase = 2.0f * pi * uni(rng);
+		w.omega = 2.0f * pi * frequency * (0.5f + uni(rng));
+		waves.push_back(w);
+		energy += 0.5f * weight * weight; // mean of amp^2 cos^2
+	}
+	for (wind_wave& w : waves) w.amp *= intensity / sqrt(energy); // RMS gust speed is intensity at unit wind speed
+}
+
+// called before the drag of every substep of every solver
+// a new sample is taken wind_interval substeps ahead of time, at the triangle centres of now
+void Cloth::advance_wind(float dt, bool soa) {
+	if (waves.empty()) return;
+	if (wind_step < 0) { // nothing sampled yet, the older sample is now
+		sample_wind(soa, wind_time, wind_shift);
+		wind_step = wind_interval;
+	}
+	if (wind_step == wind_interval) {
+		wax.swap(wbx); way.swap(wby); waz.swap(wbz);
+		double ahead = wind_interval * dt;
+		sample_wind(soa, wind_time + ahead, wind_shift + glm::dvec3(wind_v) * ahead);
+		wind_step = 0;
+	}
+	wind_blend = wind_step / float(wind_interval);
+	wind_step++;
+	wind_time += dt;
+	wind_shift += glm::dvec3(wind_v) * double(dt);
+}
+
+// gusts at every triangle centre at time t into the newer sample (wbx, wby, wbz), for a wind speed of 1
+void Cloth::sample_wind(bool soa, double t, glm::dvec3 shift) {
+	int nq = (length - 1) * (width - 1);
+	#pragma omp parallel for
+	for (int q = 0; q < nq; q++) {
+		int i = q / (width - 1), j = q % (width - 1);
+		int ind[4] = { i * width + j, i * width + j + 1, (i + 1) * width + j + 1, (i + 1) * width + j };
+		glm::vec3 c[4];
+		for (int m = 0; m < 4; m++) c[m] = soa ? glm::vec3(px[ind[m]], py[ind[m]], pz[ind[m]]) : pos[ind[m]];
+		glm::vec3 c0 = (c[0] + c[1] + c[2]) / 3.0f, c1 = (c[0] + c[2] + c[3]) / 3.0f;
+		tcx[2 * q] = c0.x; tcy[2 * q] = c0.y; tcz[2 * q] = c0.z;
+		tcx[2 * q + 1] = c1.x; tcy[2 * q + 1] = c1.y; tcz[2 * q + 1] = c1.z;
+	}
+
+	int padded = tcx.size();
+	int nw = waves.size();
+	#pragma omp parallel for
+	for (int i = 0; i < padded; i += simd::lanes) {
+		simd::vfloat x = simd::load<simd::vfloat>(tcx.data() + i);
+		simd::vfloat y = simd::load<simd::vfloat>(tcy.data() + i);
+		simd::vfloat z = simd::load<simd::vfloat>(tcz.data() + i);
+		simd::vfloat ux = simd::set1<simd::vfloat>(0.0f), uy = ux, uz = ux;
+		for (int m = 0; m < nw; m++) {
+			const wind_wave& w = waves[m];
+			// the phase of the wave at the origin grows without bound, so it is wrapped into one period before it goes to float
+			float offset = float(fmod(w.phase - w.omega * t - glm::dot(glm::dvec3(w.k), shift), 2.0 * 3.14159265358979));
+			simd::vfloat phase = simd::madd(simd::set1<simd::vfloat>(w.k.x), x, simd::madd(simd::set1<simd::vfloat>(w.k.y), y,
+				simd::madd(simd::set1<simd::vfloat>(w.k.z), z, simd::set1<simd::vfloat>(offset))));
+			simd::vfloat s, c;
+			simd::sincos(phase, s, c);
+			ux = simd::madd(c, simd::set1<simd::vfloat>(w.amp.x), ux);
+			uy = simd::madd(c, simd::set1<simd::vfloat>(w.amp.y), uy);
+			uz = simd::madd(c, simd::set1<simd::vfloat>(w.amp.z), uz);
+		}
+		simd::store(wbx.data() + i, ux);
+		simd::store(wby.data() + i, uy);
+		simd::store(wbz.data() + i, uz);
+	}
+}
+
+glm::vec3 Cloth::triangle_gust(int t) const {
+	float s = wind_blend;
+	return wind_speed * glm::vec3(wax[t] + s * (wbx[t] - wax[t]), way[t] + s * (wby[t] - way[t]), waz[t] + s * (wbz[t] - waz[t]));
+}
@@ -0,0 +1,109 @@
+// Extended position based dynamics (XPBD) solver for the string-based cloth
+// following Macklin et al., "XPBD: Position-Based Simulation of Compliant Constrained Dynamics"
+// every spring is a distance constraint with compliance 1 / k, so the stiffness does not depend
+// on the number of substeps or iterations; a spring without stiffness is no constraint at all
+// written by Yuxuan Huang
+
+#include "Cloth.h"
+
+void Cloth::set_xpbd(xpbd_solve s, int iterations) {
+	xpbd_mode = s;
+	xpbd_iter = iterations;
+}
+
+// multiplier update of spring c, n is set to the constraint direction (from b to a)
+float Cloth::spring_delta(int c, float h, glm::vec3& n) const {
+	const spring& s = springs[c];
+	glm::vec3 d = pos[s.a] - pos[s.b];
+	float len = glm::length(d);
+	float wsum = inv_mass[s.a] + inv_mass[s.b]; // pins have zero inverse mass
+	if (len < 1e-6f || wsum == 0.0f || s.k <= 0.0f) {
+		n = glm::vec3(0.0f);
+		return 0.0f;
+	}
+	n = d / len;
+
+	float C = len - s.rest;
+	float alpha = 2.0f / (s.k * h * h); // time scaled compliance, the force based solvers halve the string forces as well
+	float gamma = alpha * 0.5f * s.kv * h; // time scaled damping
+	float damp = gamma * glm::dot(n, (pos[s.a] - prev_pos[s.a]) - (pos[s.b] - prev_pos[s.b]));
+	return (-C - alpha * lambda[c] - damp) / ((1.0f + gamma) * wsum + alpha);
+}
+
+void Cloth::update_xpbd(float total_dt, int substep, glm::vec3 obs_from, glm::vec3 obs_loc, float obs_rad) {
+
+	float h = total_dt / substep;
+	int n = length * width;
+	int ns = springs.size();
+	int nbatch = batch_start.size() - 1;
+	float jacobi_relax = 1.5f; // over-relaxation of the averaged Jacobi corrections, see Macklin et al. 2014
+
+	for (int step = 0; step < substep; step++) {
+
+		// drag from the current state
+		advance_wind(h, false);
+		drag(gforce);
+
+		// predict with the external forces only
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++) {
+			prev_pos[i] = pos[i];
+			glm::vec3 acc = gforce[i] * inv_mass[i];
+			acc.z += gravity;
+			vel[i] = (vel[i] + acc * h) * free_mask[i];
+			pos[i] += vel[i] * h;
+		}
+		move_attached(step, substep, total_dt, false);
+
+		#pragma omp parallel for
+		for (int c = 0; c < ns; c++) lambda[c] = 0.0f;
+
+		for (int it = 0; it < xpbd_iter; it++) {
+			if (xpbd_mode == xpbd_solve::gauss_seidel) {
+				// batches in order, every string in a batch in parallel
+				for (int b = 0; b < nbatch; b++) {
+					#pragma omp parallel for
+					for (int c = batch_start[b]; c < batch_start[b + 1]; c++) {
+						glm::vec3 dir;
+						float dl = spring_delta(c, h, dir);
+						lambda[c] += dl;
+						pos[springs[c].a] += (inv_mass[springs[c].a] * dl) * dir;
+						pos[springs[c].b] -= (inv_mass[springs[c].b] * dl) * dir;
+					}
+				}
+			}
+			else {
+				// every string against the same positions, then every vertex averages its corrections
+				#pragma omp parallel for
+				for (int c = 0; c < ns; c++) {
+					glm::vec3 dir;
+					float dl = spring_delta(c, h, dir);
+					lambda[c] += dl;
+					spring_dx[c] = dl * dir;
+				}
+				#pragma omp parallel for
+				for (int i = 0; i < n; i++) {
+					int count = adj_start[i + 1] - adj_start[i];
+					if (count == 0 || free_mask[i] == 0.0f) continue;
+					glm::vec3 dx(0.0f);
+					for (int e = adj_start[i]; e < adj_start[i + 1]; e++) {
+						int c = adj_spring[e];
+						dx += springs[c].a == i ? spring_dx[c] : -spring_dx[c];
+					}
+					pos[i] += dx * (inv_mass[i] * jacobi_relax / float(count));
+				}
+			}
+		}
+
+		// collision & velocity from the corrected positions
+		self_collide(); // its velocity changes are overwritten below, only the positions matter here
+		glm::vec3 obs0 = obs_at(obs_from, obs_loc, step, substep);
+		glm::vec3 obs1 = obs_at(obs_from, obs_loc, step + 1, substep);
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++) {
+			if (free_mask[i] == 0.0f) continue; // exclude the pins
+			collide(i, prev_pos[i], obs0, obs1, obs_rad, h);
+			vel[i] = (pos[i] - prev_pos[i]) / h;
+		}
+	}
+}
@@ -0,0 +1,83 @@
+// The explicit string-based cloth as a template over the scalar type
+// Cloth is not an instantiation of this template: the two are separate classes that only share the explicit
+// kernels of ClothKernels.h. GridCloth<float> is the vec3 explicit solver of Cloth without its extras (sleeping,
+// gusts, attachments, strain limiting, self-collision and meshes), GridCloth<double> is the same cloth in double
+// precision to check Cloth against over a few frames; the implicit, XPBD and x/y/z paths of Cloth are float only
+// written by Yuxuan Huang
+
+#pragma once
+
+#include <vector>
+
+#include "ClothKernels.h"
+
+template<class T>
+class GridCloth {
+
+public:
+	typedef typename cloth_kernels::vec3_of<T>::type vec;
+
+	std::vector<vec> pos; // position of every conjunction
+
+	GridCloth(int length, int width, T gravity, T restlen, T mass, T k, T kv)
+		: gravity(gravity), restlen(restlen), k(k), kv(kv), wind_v(T(0)), obs_known(false) {
+		dims.length = length;
+		dims.width = width;
+
+		// same layout and pins as Cloth
+		vec upperleft((length - 1) * restlen / T(2), T(0), (width - 1) * restlen);
+		for (int i = 0; i < length; i++) {
+			for (int j = 0; j < width; j++) {
+				pos.push_back(vec(upperleft.x - i * restlen, upperleft.y + j * restlen, upperleft.z));
+			}
+		}
+		vel.assign(length * width, vec(T(0)));
+		vforce.assign(length * (width - 1), vec(T(0)));
+		hforce.assign((length - 1) * width, vec(T(0)));
+		gforce.assign(length * width, vec(T(0)));
+		tforce.assign(2 * (length - 1) * (width - 1), vec(T(0)));
+		inv_mass.assign(length * width, T(1) / mass);
+		free_mask.assign(length * width, T(1));
+		int pinned[4] = { 0, length / 3, 2 * length / 3, length - 1 };
+		for (int p : pinned) {
+			inv_mass[p * width] = T(0);
+			free_mask[p * width] = T(0);
+		}
+	}
+
+	int length() const { return dims.length; }
+	int width() const { return dims.width; }
+
+	void set_wind(vec new_speed) { wind_v = new_speed; }
+
+	// same steps as Cloth::update_aos, with the sphere swept from where it was in the last update
+	void update(T total_dt, int substep, vec obs_loc, T obs_rad) {
+		vec obs_from = obs_known ? obs_prev : obs_loc;
+		obs_prev = obs_loc;
+		obs_known = true;
+		T dt = total_dt / substep;
+
+		for (int step = 0; step < substep; step++) {
+			vec obs0 = obs_from + (obs_loc - obs_from) * (T(step) / substep);
+			vec obs1 = obs_from + (obs_loc - obs_from) * (T(step + 1) / substep);
+
+			cloth_kernels::explicit_state<T> s = { pos.data(), vel.data(), vforce.data(), hforce.data(), tforce.data(), gforce.data(),
+				nullptr, inv_mass.data(), free_mask.data(), nullptr };
+			vec wind = wind_v;
+			cloth_kernels::explicit_substep<T>(dims, s, k, kv, restlen, gravity, dt,
+				[wind](int, vec& w0, vec& w1) { w0 = wind; w1 = wind; },
+				[&](int ind, vec start) { cloth_kernels::sweep_sphere<T>(pos[ind], vel[ind], start, obs0, obs1, obs_rad, dt); });
+		}
+	}
+
+private:
+	cloth_kernels::grid dims;
+	T gravity, restlen, k, kv;
+	std::vector<vec> vel;
+	std::vector<vec> vforce, hforce; // force in every vertical and horizontal string
+	std::vector<vec> gforce, tforce; // drag on every vertex and on each vertex of every triangle
+	std::vector<T> inv_mass, free_mask; // 0 for the pins
+	vec wind_v;
+	vec obs_prev;
+	bool obs_known;
+};
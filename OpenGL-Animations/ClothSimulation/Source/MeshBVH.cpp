@@ -0,0 +1,307 @@
+// A bounding volume hierarchy over a triangle mesh, used as a collider by the cloth
+// written by Yuxuan Huang
+
+#include "MeshBVH.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+	const int bins = 12; // candidate split planes per node
+	const int leaf_size = 4; // nodes this small are never split
+
+	// binned SAH does not bound the depth (a mesh with a few huge triangles among many tiny ones can chain),
+	// so nodes this deep become leaves whatever their size, and the stack of closest() always has room
+	const int max_depth = 48;
+	const int stack_size = 64;
+	static_assert(max_depth + 1 <= stack_size, "an inner node at depth d leaves at most d + 2 nodes on the stack");
+
+	float half_area(const glm::vec3& lo, const glm::vec3& hi) {
+		glm::vec3 d = hi - lo;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	// squared distance from p to a box, 0 inside
+	float box_dist2(const glm::vec3& p, const glm::vec3& lo, const glm::vec3& hi) {
+		glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+		return glm::dot(d, d);
+	}
+
+	// closest point to p on triangle abc, from Ericson, "Real-Time Collision Detection" 5.1.5
+	glm::vec3 closest_on_triangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+		glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) return b;
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + (d1 / (d1 - d3)) * ab;
+
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) return c;
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + (d2 / (d2 - d6)) * ac;
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+
+		float denom = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	// barycentric weights of q on triangle abc, Ericson 3.4
+	glm::vec3 barycentric(const glm::vec3& q, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+		glm::vec3 ab = b - a, ac = c - a, aq = q - a;
+		float d00 = glm::dot(ab, ab), d01 = glm::dot(ab, ac), d11 = glm::dot(ac, ac);
+		float d20 = glm::dot(aq, ab), d21 = glm::dot(aq, ac);
+		float denom = d00 * d11 - d01 * d01;
+		if (denom <= 0.0f) return glm::vec3(1.0f, 0.0f, 0.0f); // degenerate triangle, take a corner
+		float v = (d11 * d20 - d01 * d21) / denom;
+		float w = (d00 * d21 - d01 * d20) / denom;
+		return glm::vec3(1.0f - v - w, v, w);
+	}
+}
+
+MeshBVH::MeshBVH(const vector<float>& triangles) : reach(0.0f), placed(false) {
+	int ntri = triangles.size() / 9;
+	local.resize(3 * ntri);
+	vector<glm::vec3> centroid(ntri);
+	for (int t = 0; t < ntri; t++) {
+		for (int m = 0; m < 3; m++) {
+			local[3 * t + m] = glm::vec3(triangles[9 * t + 3 * m], triangles[9 * t + 3 * m + 1], triangles[9 * t + 3 * m + 2]);
+		}
+		centroid[t] = (local[3 * t] + local[3 * t + 1] + local[3 * t + 2]) / 3.0f;
+	}
+
+	nodes.reserve(2 * ntri);
+	if (ntri > 0) build(0, ntri, 0, centroid);
+	world = local;
+	refit();
+}
+
+int MeshBVH::triangle_count() const {
+	return local.size() / 3;
+}
+
+int MeshBVH::node_count() const {
+	return nodes.size();
+}
+
+// box of triangles [first, last), from the local corners while the tree is being built
+void MeshBVH::triangle_box(int first, int last, glm::vec3& lo, glm::vec3& hi) const {
+	lo = glm::vec3(1e30f);
+	hi = glm::vec3(-1e30f);
+	for (int i = 3 * first; i < 3 * last; i++) {
+		lo = glm::min(lo, world.empty() ? local[i] : world[i]);
+		hi = glm::max(hi, world.empty() ? local[i] : world[i]);
+	}
+}
+
+// binned SAH: the centroids are dropped into bins along the widest axis,
+// and the split with the lowest area * count cost wins
+int MeshBVH::build(int first, int last, int depth, vector<glm::vec3>& centroid) {
+	int index = nodes.size();
+	nodes.push_back(node());
+	int count = last - first;
+
+	glm::vec3 lo, hi;
+	triangle_box(first, last, lo, hi);
+	nodes[index].lo = lo;
+	nodes[index].hi = hi;
+
+	glm::vec3 clo(1e30f), chi(-1e30f);
+	for (int t = first; t < last; t++) {
+		clo = glm::min(clo, centroid[t]);
+		chi = glm::max(chi, centroid[t]);
+	}
+	glm::vec3 extent = chi - clo;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	if (count <= leaf_size || extent[axis] <= 0.0f || depth >= max_depth) { // too small, all centroids in one spot, or too deep
+		nodes[index].start = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	// fill the bins
+	int bin_count[bins] = {};
+	glm::vec3 bin_lo[bins], bin_hi[bins];
+	for (int b = 0; b < bins; b++) {
+		bin_lo[b] = glm::vec3(1e30f);
+		bin_hi[b] = glm::vec3(-1e30f);
+	}
+	float scale = bins / extent[axis];
+	for (int t = first; t < last; t++) {
+		int b = glm::min(bins - 1, int((centroid[t][axis] - clo[axis]) * scale));
+		bin_count[b]++;
+		for (int m = 0; m < 3; m++) {
+			bin_lo[b] = glm::min(bin_lo[b], local[3 * t + m]);
+			bin_hi[b] = glm::max(bin_hi[b], local[3 * t + m]);
+		}
+	}
+
+	// sweep from both sides for the cost of every split plane
+	float right_cost[bins];
+	glm::vec3 slo(1e30f), shi(-1e30f);
+	int n = 0;
+	for (int b = bins - 1; b > 0; b--) {
+		slo = glm::min(slo, bin_lo[b]);
+		shi = glm::max(shi, bin_hi[b]);
+		n += bin_count[b];
+		right_cost[b] = n > 0 ? n * half_area(slo, shi) : 0.0f;
+	}
+	float best_cost = count * half_area(lo, hi); // cost of keeping a leaf
+	int best_split = -1;
+	slo = glm::vec3(1e30f);
+	shi = glm::vec3(-1e30f);
+	n = 0;
+	for (int b = 0; b < bins - 1; b++) {
+		slo = glm::min(slo, bin_lo[b]);
+		shi = glm::max(shi, bin_hi[b]);
+		n += bin_count[b];
+		if (n == 0 || n == count) continue;
+		float cost = n * half_area(slo, shi) + right_cost[b + 1];
+		if (cost < best_cost) {
+			best_cost = cost;
+			best_split = b + 1;
+		}
+	}
+
+	int mid = first;
+	if (best_split >= 0) {
+		// move the triangles of the left bins to the front
+		for (int t = first; t < last; t++) {
+			int b = glm::min(bins - 1, int((centroid[t][axis] - clo[axis]) * scale));
+			if (b < best_split) {
+				swap(centroid[t], centroid[mid]);
+				for (int m = 0; m < 3; m++) swap(local[3 * t + m], local[3 * mid + m]);
+				mid++;
+			}
+		}
+	}
+	else if (count > 2 * leaf_size) {
+		// no split is cheaper than a leaf, but a huge leaf is slow to query, so split at the median
+		mid = (first + last) / 2;
+		vector<int> order(count);
+		for (int t = 0; t < count; t++) order[t] = first + t;
+		nth_element(order.begin(), order.begin() + (mid - first), order.end(),
+			[&](int a, int b) { return centroid[a][axis] < centroid[b][axis]; });
+		vector<glm::vec3> c(count), l(3 * count);
+		for (int t = 0; t < count; t++) {
+			c[t] = centroid[order[t]];
+			for (int m = 0; m < 3; m++) l[3 * t + m] = local[3 * order[t] + m];
+		}
+		copy(c.begin(), c.end(), centroid.begin() + first);
+		copy(l.begin(), l.end(), local.begin() + 3 * first);
+	}
+	else {
+		nodes[index].start = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	build(first, mid, depth + 1, centroid); // the left child lands right after this node
+	int right = build(mid, last, depth + 1, centroid);
+	nodes[index].start = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+void MeshBVH::set_transform(const glm::mat4& model) {
+	int n = local.size();
+	if (placed && prev.empty()) prev = world; // first move of this frame
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) world[i] = glm::vec3(model * glm::vec4(local[i], 1.0f));
+	refit();
+
+	if (prev.empty()) return;
+	reach = 0.0f;
+	for (int i = 0; i < n; i++) reach = glm::max(reach, glm::length(world[i] - prev[i]));
+}
+
+void MeshBVH::settle() {
+	prev.clear();
+	reach = 0.0f;
+	placed = true;
+}
+
+float MeshBVH::motion() const {
+	return reach;
+}
+
+// children come after their parent, so one backward sweep updates every box
+void MeshBVH::refit() {
+	int nn = nodes.size();
+	#pragma omp parallel for
+	for (int i = 0; i < nn; i++) {
+		if (nodes[i].count > 0) triangle_box(nodes[i].start, nodes[i].start + nodes[i].count, nodes[i].lo, nodes[i].hi);
+	}
+	for (int i = nn - 1; i >= 0; i--) {
+		if (nodes[i].count > 0) continue;
+		const node& l = nodes[i + 1];
+		const node& r = nodes[nodes[i].start];
+		nodes[i].lo = glm::min(l.lo, r.lo);
+		nodes[i].hi = glm::max(l.hi, r.hi);
+	}
+}
+
+bool MeshBVH::closest(glm::vec3 p, float radius, glm::vec3& point, glm::vec3& normal, glm::vec3& moved) const {
+	if (nodes.empty()) return false;
+
+	float best = radius * radius;
+	int best_tri = -1;
+	int stack[stack_size];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const node& nd = nodes[stack[--top]];
+		if (box_dist2(p, nd.lo, nd.hi) > best) continue;
+
+		if (nd.count > 0) {
+			for (int t = nd.start; t < nd.start + nd.count; t++) {
+				glm::vec3 q = closest_on_triangle(p, world[3 * t], world[3 * t + 1], world[3 * t + 2]);
+				float d2 = glm::dot(p - q, p - q);
+				if (d2 <= best) {
+					best = d2;
+					best_tri = t;
+					point = q;
+				}
+			}
+			continue;
+		}
+
+		// visit the nearer child first so the search radius shrinks sooner
+		int l = &nd - &nodes[0] + 1, r = nd.start;
+		float dl = box_dist2(p, nodes[l].lo, nodes[l].hi), dr = box_dist2(p, nodes[r].lo, nodes[r].hi);
+		assert(top + 2 <= stack_size); // build() caps the depth
+		if (dl < dr) {
+			stack[top++] = r;
+			stack[top++] = l;
+		}
+		else {
+			stack[top++] = l;
+			stack[top++] = r;
+		}
+	}
+	if (best_tri < 0) return false;
+
+	glm::vec3 a = world[3 * best_tri];
+	normal = glm::cross(world[3 * best_tri + 1] - a, world[3 * best_tri + 2] - a);
+	float len = glm::length(normal);
+	normal = len > 0.0f ? normal / len : glm::vec3(0.0f, 0.0f, 1.0f);
+
+	moved = glm::vec3(0.0f);
+	if (!prev.empty()) {
+		glm::vec3 w = barycentric(point, a, world[3 * best_tri + 1], world[3 * best_tri + 2]);
+		moved = point - (w.x * prev[3 * best_tri] + w.y * prev[3 * best_tri + 1] + w.z * prev[3 * best_tri + 2]);
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+// A bounding volume hierarchy over a triangle mesh, used as a collider by the cloth
+// the tree is built once with the surface area heuristic, moving the mesh only refits the boxes
+// written by Yuxuan Huang
+
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include "../../../glm/glm.hpp"
+#include "../../../glm/gtc/matrix_transform.hpp"
+#include "../../../glm/gtc/type_ptr.hpp"
+
+#include <vector>
+
+using namespace std;
+
+class MeshBVH {
+
+public:
+	// triangles: xyz of the three corners of every triangle, in the format loadobj() returns
+	// the corners are expected counter-clockwise seen from outside, like any exported obj
+	MeshBVH(const vector<float>& triangles);
+
+	// place the mesh in the world, refits the tree
+	// the moves since the last settle() make up the mesh's motion over the coming frame, the very first placement is not a move
+	void set_transform(const glm::mat4& model);
+	void settle(); // the frame is over, the mesh stands still until it is moved again
+	float motion() const; // farthest any corner moved since the last settle()
+
+	// closest point of the mesh within radius of p, the outward face normal there,
+	// and how far that point of the surface moved since the last settle()
+	// returns false if no triangle is that close
+	bool closest(glm::vec3 p, float radius, glm::vec3& point, glm::vec3& normal, glm::vec3& moved) const;
+
+	int triangle_count() const;
+	int node_count() const;
+
+private:
+	struct node {
+		glm::vec3 lo, hi; // bounding box
+		int start; // leaf: first triangle, inner: index of the right child (the left one follows the node)
+		int count; // triangles in a leaf, 0 for inner nodes
+	};
+
+	vector<glm::vec3> local; // triangle corners in the mesh's own frame, three per triangle, in tree order
+	vector<glm::vec3> world; // the same corners after the current transform
+	vector<glm::vec3> prev; // the corners at the last settle(), empty while the mesh stands still
+	float reach; // farthest any corner moved since the last settle()
+	bool placed; // settle() was called once, later transforms are moves
+	vector<node> nodes; // depth first, children always after their parent
+
+	int build(int first, int last, int depth, vector<glm::vec3>& centroid); // split triangles [first, last), returns the node index
+	void triangle_box(int first, int last, glm::vec3& lo, glm::vec3& hi) const;
+	void refit();
+};
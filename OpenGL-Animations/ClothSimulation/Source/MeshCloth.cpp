@@ -0,0 +1,340 @@
+// A mass-spring cloth of any triangle mesh, e.g. a garment or a banner loaded with loadobj()
+// written by Yuxuan Huang
+
+#include "MeshCloth.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <tuple>
+
+namespace {
+
+	// spreads the low 10 bits of x so there are two zero bits between any two of them
+	unsigned spread_bits(unsigned x) {
+		x &= 0x3ff;
+		x = (x | (x << 16)) & 0x30000ff;
+		x = (x | (x << 8)) & 0x300f00f;
+		x = (x | (x << 4)) & 0x30c30c3;
+		x = (x | (x << 2)) & 0x9249249;
+		return x;
+	}
+}
+
+MeshCloth::MeshCloth(const vector<float>& triangles, const vector<float>& uvs, float g, float m, float k_p, float kv_p, ordering order) {
+	gravity = g;
+	mass = m;
+	k = k_p;
+	kv = kv_p;
+	wind_v = glm::vec3(0.0f);
+
+	weld(triangles, uvs);
+	build_adjacency();
+	if (order == ordering::rcm) renumber(rcm_order());
+	if (order == ordering::morton) renumber(morton_order());
+
+	int n = pos.size();
+	vel.assign(n, glm::vec3(0.0f));
+	free_mask.assign(n, 1.0f);
+	eforce.assign(rest.size(), glm::vec3(0.0f));
+	tforce.assign(tris.size() / 3, glm::vec3(0.0f));
+}
+
+// loadobj() writes out every corner of every triangle, so the shared corners come back together here
+void MeshCloth::weld(const vector<float>& triangles, const vector<float>& uvs) {
+	map<tuple<float, float, float>, int> index;
+	int corners = triangles.size() / 3;
+	for (int c = 0; c < corners; c++) {
+		glm::vec3 p(triangles[3 * c], triangles[3 * c + 1], triangles[3 * c + 2]);
+		auto found = index.insert(make_pair(make_tuple(p.x, p.y, p.z), int(pos.size())));
+		if (found.second) {
+			pos.push_back(p);
+			uv.push_back(uvs.empty() ? 0.0f : uvs[2 * c]);
+			uv.push_back(uvs.empty() ? 0.0f : uvs[2 * c + 1]);
+		}
+		tris.push_back(found.first->second);
+	}
+
+	// drop the triangles that collapsed to an edge or a point
+	int kept = 0;
+	for (int t = 0; t < corners / 3; t++) {
+		int a = tris[3 * t], b = tris[3 * t + 1], c = tris[3 * t + 2];
+		if (a == b || b == c || c == a) continue;
+		tris[3 * kept] = a;
+		tris[3 * kept + 1] = b;
+		tris[3 * kept + 2] = c;
+		kept++;
+	}
+	tris.resize(3 * kept);
+}
+
+// the unique edges of the triangles, and the neighbours and triangles of every vertex in compressed rows
+void MeshCloth::build_adjacency() {
+	int n = pos.size();
+	int nt = tris.size() / 3;
+
+	vector<pair<int, int> > edges;
+	for (int t = 0; t < nt; t++) {
+		for (int m = 0; m < 3; m++) {
+			int a = tris[3 * t + m], b = tris[3 * t + (m + 1) % 3];
+			edges.push_back(make_pair(min(a, b), max(a, b)));
+		}
+	}
+	sort(edges.begin(), edges.end());
+	edges.erase(unique(edges.begin(), edges.end()), edges.end());
+	int ne = edges.size();
+
+	rest.resize(ne);
+	edge_end.resize(2 * ne);
+	for (int e = 0; e < ne; e++) {
+		rest[e] = glm::length(pos[edges[e].second] - pos[edges[e].first]);
+		edge_end[2 * e] = edges[e].first;
+		edge_end[2 * e + 1] = edges[e].second;
+	}
+
+	// every edge goes into the rows of both ends, sorted by row and then by neighbour
+	vector<tuple<int, int, int> > half;
+	for (int e = 0; e < ne; e++) {
+		half.push_back(make_tuple(edges[e].first, edges[e].second, e));
+		half.push_back(make_tuple(edges[e].second, edges[e].first, e));
+	}
+	sort(half.begin(), half.end());
+	adj_start.assign(n + 1, 0);
+	adj_vertex.resize(2 * ne);
+	adj_edge.resize(2 * ne);
+	for (int r = 0; r < 2 * ne; r++) {
+		adj_start[get<0>(half[r]) + 1]++;
+		adj_vertex[r] = get<1>(half[r]);
+		adj_edge[r] = get<2>(half[r]);
+	}
+	for (int v = 0; v < n; v++) adj_start[v + 1] += adj_start[v];
+
+	vtri_start.assign(n + 1, 0);
+	for (int c = 0; c < 3 * nt; c++) vtri_start[tris[c] + 1]++;
+	for (int v = 0; v < n; v++) vtri_start[v + 1] += vtri_start[v];
+	vtri.resize(3 * nt);
+	vector<int> fill(vtri_start.begin(), vtri_start.end() - 1);
+	for (int c = 0; c < 3 * nt; c++) vtri[fill[tris[c]]++] = c / 3;
+}
+
+// breadth first from a vertex of lowest degree in every connected piece, neighbours taken by increasing degree,
+// then reversed, which keeps the neighbours of every vertex close to it in memory
+vector<int> MeshCloth::rcm_order() const {
+	int n = pos.size();
+	vector<int> degree(n), by_degree(n);
+	for (int v = 0; v < n; v++) {
+		degree[v] = adj_start[v + 1] - adj_start[v];
+		by_degree[v] = v;
+	}
+	stable_sort(by_degree.begin(), by_degree.end(), [&](int a, int b) { return degree[a] < degree[b]; });
+
+	vector<int> order;
+	vector<char> visited(n, 0);
+	vector<int> next;
+	for (int seed : by_degree) {
+		if (visited[seed]) continue;
+		visited[seed] = 1;
+		int head = order.size();
+		order.push_back(seed);
+		while (head < order.size()) {
+			int v = order[head++];
+			next.clear();
+			for (int r = adj_start[v]; r < adj_start[v + 1]; r++) {
+				if (!visited[adj_vertex[r]]) {
+					visited[adj_vertex[r]] = 1;
+					next.push_back(adj_vertex[r]);
+				}
+			}
+			stable_sort(next.begin(), next.end(), [&](int a, int b) { return degree[a] < degree[b]; });
+			order.insert(order.end(), next.begin(), next.end());
+		}
+	}
+	reverse(order.begin(), order.end());
+	return order;
+}
+
+// sorted by the interleaved bits of the position quantized to 1024 steps along each side of the bounding box
+vector<int> MeshCloth::morton_order() const {
+	int n = pos.size();
+	glm::vec3 lo(1e30f), hi(-1e30f);
+	for (int v = 0; v < n; v++) {
+		lo = glm::min(lo, pos[v]);
+		hi = glm::max(hi, pos[v]);
+	}
+	glm::vec3 scale = 1023.0f / glm::max(hi - lo, glm::vec3(1e-6f));
+
+	vector<pair<unsigned, int> > code(n);
+	for (int v = 0; v < n; v++) {
+		glm::vec3 q = (pos[v] - lo) * scale;
+		code[v] = make_pair(spread_bits(unsigned(q.x)) | (spread_bits(unsigned(q.y)) << 1) | (spread_bits(unsigned(q.z)) << 2), v);
+	}
+	sort(code.begin(), code.end());
+	vector<int> order(n);
+	for (int v = 0; v < n; v++) order[v] = code[v].second;
+	return order;
+}
+
+void MeshCloth::renumber(const vector<int>& order) {
+	int n = pos.size();
+	vector<int> new_index(n);
+	vector<glm::vec3> p(n);
+	vector<float> u(2 * n);
+	for (int v = 0; v < n; v++) {
+		new_index[order[v]] = v;
+		p[v] = pos[order[v]];
+		u[2 * v] = uv[2 * order[v]];
+		u[2 * v + 1] = uv[2 * order[v] + 1];
+	}
+	pos.swap(p);
+	uv.swap(u);
+	for (int c = 0; c < tris.size(); c++) tris[c] = new_index[tris[c]];
+
+	// the triangles follow their smallest vertex, so the drag pass walks the vertices in order too
+	int nt = tris.size() / 3;
+	vector<pair<int, int> > first(nt);
+	for (int t = 0; t < nt; t++) first[t] = make_pair(min(tris[3 * t], min(tris[3 * t + 1], tris[3 * t + 2])), t);
+	sort(first.begin(), first.end());
+	vector<int> sorted(3 * nt);
+	for (int t = 0; t < nt; t++) {
+		for (int m = 0; m < 3; m++) sorted[3 * t + m] = tris[3 * first[t].second + m];
+	}
+	tris.swap(sorted);
+
+	build_adjacency();
+}
+
+int MeshCloth::vertex_count() const {
+	return pos.size();
+}
+
+int MeshCloth::edge_count() const {
+	return rest.size();
+}
+
+int MeshCloth::bandwidth() const {
+	int band = 0;
+	for (int v = 0; v < pos.size(); v++) {
+		for (int r = adj_start[v]; r < adj_start[v + 1]; r++) band = max(band, abs(adj_vertex[r] - v));
+	}
+	return band;
+}
+
+int MeshCloth::closest_vertex(glm::vec3 p) const {
+	int best = 0;
+	for (int v = 1; v < pos.size(); v++) {
+		if (glm::dot(pos[v] - p, pos[v] - p) < glm::dot(pos[best] - p, pos[best] - p)) best = v;
+	}
+	return best;
+}
+
+void MeshCloth::set_pinned(int vertex, bool pinned) {
+	free_mask[vertex] = pinned ? 0.0f : 1.0f;
+	if (pinned) vel[vertex] = glm::vec3(0.0f);
+}
+
+void MeshCloth::set_wind(glm::vec3 new_speed) {
+	wind_v = new_speed;
+}
+
+vector<int> MeshCloth::get_index() const {
+	return tris;
+}
+
+vector<float> MeshCloth::get_uv() const {
+	return uv;
+}
+
+int MeshCloth::render_floats() const {
+	return 6 * pos.size();
+}
+
+glm::vec3 MeshCloth::triangle_normal(int t) const {
+	glm::vec3 a = pos[tris[3 * t]];
+	return glm::cross(pos[tris[3 * t + 1]] - a, pos[tris[3 * t + 2]] - a);
+}
+
+// every vertex sums the unit normals of its own triangles, so nothing is shared between threads
+void MeshCloth::write_render(float* out) const {
+	int n = pos.size();
+	#pragma omp parallel for
+	for (int v = 0; v < n; v++) {
+		glm::vec3 nr(0.0f);
+		for (int r = vtri_start[v]; r < vtri_start[v + 1]; r++) {
+			glm::vec3 tn = triangle_normal(vtri[r]);
+			float len = glm::length(tn);
+			if (len > 0.0f) nr += tn / len;
+		}
+		float len = glm::length(nr);
+		if (len > 0.0f) nr /= len;
+		float* o = out + 6 * v;
+		o[0] = pos[v].x; o[1] = pos[v].y; o[2] = pos[v].z;
+		o[3] = nr.x; o[4] = nr.y; o[5] = nr.z;
+	}
+}
+
+// one slot per edge, so every string is evaluated once and no two threads write the same force
+void MeshCloth::string_forces() {
+	int ne = rest.size();
+	#pragma omp parallel for
+	for (int e = 0; e < ne; e++) {
+		int a = edge_end[2 * e], b = edge_end[2 * e + 1];
+		glm::vec3 d = pos[b] - pos[a];
+		float len = glm::length(d);
+		if (len <= 0.0f) {
+			eforce[e] = glm::vec3(0.0f);
+			continue;
+		}
+		d /= len;
+		float stringF = k * (len - rest[e]); // pulls a towards b when stretched
+		float dampF = kv * glm::dot(vel[b] - vel[a], d);
+		eforce[e] = (stringF + dampF) * d;
+	}
+}
+
+// same drag as Cloth::drag, one slot per triangle (every corner gets a third of it)
+void MeshCloth::drag() {
+	float c = 2.0f;
+	int nt = tris.size() / 3;
+	#pragma omp parallel for
+	for (int t = 0; t < nt; t++) {
+		int a = tris[3 * t], b = tris[3 * t + 1], d = tris[3 * t + 2];
+		glm::vec3 v = (vel[a] + vel[b] + vel[d]) / 3.0f - wind_v; // average velocity relative to the air
+		glm::vec3 n = triangle_normal(t);
+		float len = glm::length(n);
+		tforce[t] = len > 0.0f ? -0.5f * c * (glm::length(v) * glm::dot(v, n) / (2.0f * len)) * n / 3.0f : glm::vec3(0.0f);
+	}
+}
+
+void MeshCloth::update(float total_dt, int substep, glm::vec3 obs_loc, float obs_rad) {
+	int n = pos.size();
+	float dt = total_dt / substep;
+
+	for (int step = 0; step < substep; step++) {
+		string_forces();
+		drag();
+
+		// every vertex gathers its own edges and triangles in a fixed order, then the string forces are halved as in Cloth
+		#pragma omp parallel for
+		for (int v = 0; v < n; v++) {
+			glm::vec3 f(0.0f), fd(0.0f);
+			for (int r = adj_start[v]; r < adj_start[v + 1]; r++) {
+				if (adj_vertex[r] > v) f += eforce[adj_edge[r]];
+				else f -= eforce[adj_edge[r]];
+			}
+			for (int r = vtri_start[v]; r < vtri_start[v + 1]; r++) fd += tforce[vtri[r]];
+			glm::vec3 acc = (0.5f * f + fd) / mass;
+			acc.z += gravity;
+			vel[v] = (vel[v] + acc * dt) * free_mask[v];
+			pos[v] += vel[v] * dt;
+
+			// sphere, pushed out and bounced as in Cloth, but tested at the end of the substep only
+			glm::vec3 rel = pos[v] - obs_loc;
+			float dist = glm::length(rel);
+			if (free_mask[v] == 0.0f || dist > obs_rad + 0.1f || dist <= 0.0f) continue;
+			glm::vec3 nrm = rel / dist;
+			pos[v] = obs_loc + (obs_rad + 0.2f) * nrm;
+			float vn = glm::dot(vel[v], nrm);
+			if (vn < 0.0f) vel[v] -= 1.1f * vn * nrm;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+// A mass-spring cloth of any triangle mesh, e.g. a garment or a banner loaded with loadobj()
+// every unique edge of the mesh is a string, evaluated once per substep and gathered by the neighbours of every vertex in compressed rows
+// written by Yuxuan Huang
+
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include "../../../glm/glm.hpp"
+#include "../../../glm/gtc/matrix_transform.hpp"
+#include "../../../glm/gtc/type_ptr.hpp"
+
+#include <vector>
+
+using namespace std;
+
+class MeshCloth {
+
+public:
+	enum class ordering { input, rcm, morton }; // order of the vertices in memory
+
+	vector<glm::vec3> pos; // position of every vertex
+
+	// triangles: xyz of the three corners of every triangle, uvs: two floats per corner or empty, both as loadobj() returns them
+	// corners at the same position are welded into one vertex, the rest lengths are the distances in the mesh
+	// k and kv mean the same as for Cloth, whose solver halves the string forces
+	MeshCloth(const vector<float>& triangles, const vector<float>& uvs, float gravity, float mass, float k, float kv, ordering order);
+
+	void update(float dt, int substep, glm::vec3 obs_loc, float obs_rad); // explicit Euler, like Cloth
+
+	int vertex_count() const;
+	int edge_count() const;
+	int bandwidth() const; // largest index distance between two neighbours, the smaller the friendlier to the cache
+	int closest_vertex(glm::vec3 p) const; // for picking the vertices to pin
+	void set_pinned(int vertex, bool pinned);
+	void set_wind(glm::vec3 new_speed);
+
+	vector<int> get_index() const; // three vertices per triangle
+	vector<float> get_uv() const; // the uv of the first corner welded into each vertex
+	int render_floats() const; // floats written by write_render(), 6 per vertex
+	void write_render(float* out) const; // interleaved position & unit normal, same layout as Cloth::write_render
+
+private:
+	float gravity, mass;
+	float k, kv;
+	glm::vec3 wind_v;
+
+	vector<glm::vec3> vel;
+	vector<float> free_mask; // 0 for pinned vertices, 1 for the rest
+	vector<int> tris; // three vertices per triangle
+	vector<float> uv; // two floats per vertex
+	vector<float> rest; // rest length of every edge
+	vector<int> edge_end; // two vertices per edge, the smaller one first
+
+	// compressed rows: the neighbours of vertex v are adj_vertex[adj_start[v]] ... adj_vertex[adj_start[v + 1] - 1],
+	// sorted by index, and adj_edge holds the edge to each of them
+	vector<int> adj_start, adj_vertex, adj_edge;
+	vector<int> vtri_start, vtri; // triangles around every vertex, in the same layout
+
+	vector<glm::vec3> eforce; // force of every edge on its first vertex, the second one gets the opposite
+	vector<glm::vec3> tforce; // drag per corner of every triangle
+
+	void weld(const vector<float>& triangles, const vector<float>& uvs);
+	vector<int> rcm_order() const; // reverse Cuthill-McKee on the vertex graph
+	vector<int> morton_order() const; // z-order curve through the bounding box
+	void renumber(const vector<int>& order); // order[new index] = old index
+	void build_adjacency();
+	void string_forces();
+	void drag();
+	glm::vec3 triangle_normal(int t) const; // unnormalized, twice the area
+};
@@ -293,6 +293,7 @@ void init() {
     up = glm::vec3(0.0f, 0.0f, 1.0f);
 
     fire = ParticleSystem(10000, 0.5f, 0.1f, 150000, glm::vec3(0, 0, -3), 2.0f, src_type::dim2, axis::Z, 5.0f, 45.0f, glm::vec3(1.0f, 1.0f, 0.0f));
+    fire.set_storage(ParticleSystem::storage::ring); // the flames die about as old as they were born
 
     sph_loc = glm::vec3(0.0f, 0.0f, 0.0f);
     env_loc = glm::vec3(0.0f, 0.0f, -3.5f);
@@ -340,7 +341,7 @@ void update(float dt, GLint shader1, GLint shader2, GLint vao1, GLint vao2) {
 
 void computePhysics(float dt) {
     fire.update(dt, ParticleSystem::particle_type::smoke, sph_loc, sph_rad);
-    //printf("Particle Count: %i \n", fire.Pos.size());
+    //printf("Particle Count: %i \n", fire.count());
 }
 
 void set_camera() {
@@ -355,12 +356,12 @@ void set_camera() {
 
 void draw_particles() {
     // iterate through all particles
-    for (int i = 0; i < fire.Pos.size(); i++) {
+    for (int i = 0; i < fire.count(); i++) {
         glm::mat4 model = glm::mat4();
-        model = glm::translate(model, fire.Pos[i]);
-        glPointSize(autosize(cam_loc, fire.Pos[i], 150.0f));
+        model = glm::translate(model, fire.pos(i));
+        glPointSize(autosize(cam_loc, fire.pos(i), 150.0f));
         glUniformMatrix4fv(uniModel, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform3f(uniColor, fire.Clr[i].r, fire.Clr[i].g, fire.Clr[i].b);
+        glUniform3f(uniColor, fire.color(i).r, fire.color(i).g, fire.color(i).b);
         glDrawArrays(GL_POINTS, 0, 1); //(Primitives, starting index, Number of vertices)
     }
 
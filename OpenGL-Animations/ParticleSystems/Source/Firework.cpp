@@ -39,6 +39,7 @@
 #include "../../../glm/gtc/type_ptr.hpp"
 
 #include "ParticleSystem.h"
+#include "../../Tools/Random.h"
 #include "../../Tools/FileLoader.h"
 #include "../../Tools/ExportTools.h"
 #include "../../Tools/UserControl.h"
@@ -87,9 +88,11 @@ public:
     ParticleSystem tail;
 
     firework() { // default firework
+        key = fireworks++;
+        draws = 0;
         position = glm::vec3(0.0f, 0.0f, 0.0f);
         interval = 4.0f;
-        delay = 3 * static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+        delay = 3 * uniform();
         timer = interval;
         stage = 0;
         sphere_loc.push_back(position);
@@ -99,7 +102,7 @@ public:
         expl_count = 200;
         r_life = 1.6f;
         p_life = 1.5f;
-        color_type = int(3 * static_cast <float> (rand()) / static_cast <float> (RAND_MAX));
+        color_type = int(3 * uniform());
 
         sphere_life.push_back(r_life);
         sphere_life_ini.push_back(r_life);
@@ -109,9 +112,11 @@ public:
     }
 
     firework(glm::vec3 pos, float t, float rlife, float plife, int explc) { // customized firework
+        key = fireworks++;
+        draws = 0;
         position = pos;
         interval = t;
-        delay = 3 * static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+        delay = 3 * uniform();
         timer = interval;
         stage = 0;
         sphere_loc.push_back(position);
@@ -121,7 +126,7 @@ public:
         expl_count = explc;
         r_life = rlife;
         p_life = plife;
-        color_type = int(3 * static_cast <float> (rand()) / static_cast <float> (RAND_MAX));
+        color_type = int(3 * uniform());
 
         sphere_life.push_back(rlife);
         sphere_life_ini.push_back(r_life);
@@ -168,7 +173,7 @@ public:
                 sphere_loc.push_back(position);
                 sphere_vel.push_back(glm::vec3(0.0f + noise(0.1f), 0.0f + noise(0.1f), 15.0f + noise(0.1f)));
                 sphere_col.push_back(glm::vec3(1.0f, 1.0f, 1.0f));
-                color_type = int(3 * static_cast <float> (rand()) / static_cast <float> (RAND_MAX));
+                color_type = int(3 * uniform());
                 sphere_life.push_back(1.6f);
                 sphere_life_ini.push_back(1.6f);
 
@@ -191,6 +196,16 @@ private:
 
     int color_type;
 
+    // random numbers keyed by the firework and counted per draw (the particle systems use key (emitter, 0))
+    static uint32_t fireworks; // fireworks made so far
+    uint32_t key;
+    uint32_t draws;
+
+    // generate random float in [0, 1)
+    float uniform() {
+        return rng::uniform(draws++, 0, 0, key, 1);
+    }
+
 
     // explosion creates a number of smaller spheres
     void explode() {
@@ -227,14 +242,16 @@ private:
 
     // generate random float in [-0.5, +0.5] * scale
     float noise(float scale) {
-        return scale * static_cast <float> (rand()) / static_cast <float> (RAND_MAX) - 0.5;
+        return scale * uniform() - 0.5;
     }
 
     // sample velocity on a sphere
     glm::vec3 sample_vel() {
-        float theta = 2 * M_PI * static_cast <float> (rand()) / static_cast <float> (RAND_MAX);  // 0 - 2PI
-        float phi = M_PI * static_cast <float> (rand()) / static_cast <float> (RAND_MAX); // 0 - PI
-        float noise = 1 - (0.1f * static_cast <float> (rand()) / static_cast <float> (RAND_MAX)); // 0.9 - 1
+        float u[4];
+        rng::uniform4(u, draws++, 0, 0, 0, key, 1); // one counter for all three
+        float theta = 2 * M_PI * u[0];  // 0 - 2PI
+        float phi = M_PI * u[1]; // 0 - PI
+        float noise = 1 - (0.1f * u[2]); // 0.9 - 1
         return noise * glm::vec3(cos(theta) * sin(phi), sin(theta) * sin(phi), cos(phi));
     }
 
@@ -262,6 +279,8 @@ private:
     }
 };
 
+uint32_t firework::fireworks = 0;
+
 const int fw_num = 5;
 firework fw[fw_num];
 
@@ -459,7 +478,7 @@ void computePhysics(float dt) {
     for (int f = 0; f < fw_num; f++) {
         fw[f].update(dt);
     }
-    //printf("Particle Count: %i \n", fire.Pos.size());
+    //printf("Particle Count: %i \n", fire.count());
 }
 
 void set_camera() {
@@ -499,12 +518,12 @@ void draw_sphere() {
 void draw_ico() {
     // draw every icosphere in firework0's list
     for (int f = 0; f < fw_num; f++) {
-        for (int i = 0; i < fw[f].tail.Pos.size(); i++) {
+        for (int i = 0; i < fw[f].tail.count(); i++) {
             glm::mat4 model = glm::mat4();
-            model = glm::translate(model, fw[f].tail.Pos[i]);
+            model = glm::translate(model, fw[f].tail.pos(i));
             model = glm::scale(model, glm::vec3(tail_rad));
             glUniformMatrix4fv(uniModel, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform3f(uniColor, fw[f].tail.Clr[i].r, fw[f].tail.Clr[i].g, fw[f].tail.Clr[i].b);
+            glUniform3f(uniColor, fw[f].tail.color(i).r, fw[f].tail.color(i).g, fw[f].tail.color(i).b);
             glDrawArrays(GL_TRIANGLES, sph_vert / 3, ico_vert / 3); //(Primitives, starting index, Number of vertices)
         }
     }
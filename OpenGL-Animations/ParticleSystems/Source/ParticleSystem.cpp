@@ -2,11 +2,133 @@
 
 #include "ParticleSystem.h"
 #include <cmath>
-#include <ctime>
-#include <cstdlib>
+#include <algorithm>
+
+#include "../../Tools/Random.h"
 
 float g = -9.8;
 
+uint32_t ParticleSystem::emitters = 0;
+
+namespace {
+
+	// raw pointers into the arrays of one particle system
+	struct particle_arrays {
+		float *px, *py, *pz; // positions
+		float *qx, *qy, *qz; // positions at the start of the step
+		float *vx, *vy, *vz; // velocities
+		float *cg; // green, the only color channel update() changes
+		float *life;
+	};
+
+	// a where mask is 1 and b where it is 0, exact as long as both are finite
+	template<class V>
+	inline V blend(V mask, V a, V b) {
+		return simd::madd(a, mask, simd::mul(b, simd::sub(simd::set1<V>(1.0f), mask)));
+	}
+
+	// one step of the particles from i on (one register of them, or one particle for the tail):
+	// keep where they start, move them, accelerate them by (0, 0, az) and scale their horizontal velocity by drag,
+	// fade the green channel with the life left when fade is set, then age them
+	template<class V>
+	inline void step_kernel(particle_arrays s, int i, float dt, float az, float drag, bool fade, float lifespan) {
+		V vdt = simd::set1<V>(dt);
+		V vx = simd::load<V>(s.vx + i);
+		V vy = simd::load<V>(s.vy + i);
+		V vz = simd::load<V>(s.vz + i);
+		V px = simd::load<V>(s.px + i), py = simd::load<V>(s.py + i), pz = simd::load<V>(s.pz + i);
+		simd::store(s.qx + i, px);
+		simd::store(s.qy + i, py);
+		simd::store(s.qz + i, pz);
+		simd::store(s.px + i, simd::madd(vx, vdt, px));
+		simd::store(s.py + i, simd::madd(vy, vdt, py));
+		simd::store(s.pz + i, simd::madd(vz, vdt, pz));
+		V vdrag = simd::set1<V>(drag);
+		simd::store(s.vx + i, simd::mul(vx, vdrag));
+		simd::store(s.vy + i, simd::mul(vy, vdrag));
+		simd::store(s.vz + i, simd::madd(simd::set1<V>(az), vdt, vz));
+
+		V life = simd::load<V>(s.life + i);
+		if (fade) simd::store(s.cg + i, simd::div(life, simd::set1<V>(lifespan)));
+		simd::store(s.life + i, simd::sub(life, vdt));
+	}
+
+	// push the particles from i on out of the sphere, and reflect (and halve) the velocity of those that hit it when bounce is set
+	template<class V>
+	inline void collide_kernel(particle_arrays s, int i, glm::vec3 obs_loc, float obs_rad, bool bounce) {
+		V ox = simd::set1<V>(obs_loc.x), oy = simd::set1<V>(obs_loc.y), oz = simd::set1<V>(obs_loc.z);
+		V px = simd::load<V>(s.px + i), py = simd::load<V>(s.py + i), pz = simd::load<V>(s.pz + i);
+		V dx = simd::sub(px, ox), dy = simd::sub(py, oy), dz = simd::sub(pz, oz);
+		V dis = simd::sqrt(simd::add(simd::add(simd::mul(dx, dx), simd::mul(dy, dy)), simd::mul(dz, dz)));
+		V hit = simd::le(dis, simd::set1<V>(obs_rad));
+		if (!simd::any(hit)) return; // most of them miss the sphere
+
+		// return to valid state, the lanes that missed keep their values
+		dis = simd::max(dis, simd::set1<V>(1e-12f)); // no 0 / 0 in the lanes that missed
+		dx = simd::div(dx, dis);
+		dy = simd::div(dy, dis);
+		dz = simd::div(dz, dis);
+		V out = simd::set1<V>(obs_rad + 0.01f);
+		simd::store(s.px + i, blend(hit, simd::madd(dx, out, ox), px));
+		simd::store(s.py + i, blend(hit, simd::madd(dy, out, oy), py));
+		simd::store(s.pz + i, blend(hit, simd::madd(dz, out, oz), pz));
+		if (!bounce) return;
+
+		V vx = simd::load<V>(s.vx + i), vy = simd::load<V>(s.vy + i), vz = simd::load<V>(s.vz + i);
+		V tmp = simd::add(simd::add(simd::mul(vx, dx), simd::mul(vy, dy)), simd::mul(vz, dz));
+		tmp = simd::mul(simd::set1<V>(2.0f), tmp);
+		V half = simd::set1<V>(0.5f);
+		simd::store(s.vx + i, blend(hit, simd::mul(simd::sub(vx, simd::mul(tmp, dx)), half), vx));
+		simd::store(s.vy + i, blend(hit, simd::mul(simd::sub(vy, simd::mul(tmp, dy)), half), vy));
+		simd::store(s.vz + i, blend(hit, simd::mul(simd::sub(vz, simd::mul(tmp, dz)), half), vz));
+	}
+
+	// where the new particles go and what they are drawn from
+	struct spawn_params {
+		float* pos[3]; // the two axes of the source plane then its normal, or x, y, z for a 3D source
+		float* vel[3]; // the normal of the source then the next two axes
+		float* life;
+		float src[3]; // source position in the order of pos
+		bool dim3;
+		float src_radius, max_angle, ini_vel, lifespan, lfspan_ptb;
+	};
+
+	// sample the source, the initial velocity and the lifespan of the new particles from i on, from the uniforms from j on in u:
+	// source angle, radius and polar angle, lifespan, velocity angle off the normal and around it
+	template<class V>
+	inline void sample_kernel(const spawn_params& p, const float (*u)[simd::lanes], int j, int i) {
+		const float two_pi = 6.28318531f, pi = 3.14159265f;
+		V st, ct;
+		simd::sincos(simd::mul(simd::set1<V>(two_pi), simd::load<V>(u[0] + j)), st, ct); // 0 - 2PI
+		V r = simd::sqrt(simd::mul(simd::set1<V>(p.src_radius), simd::load<V>(u[1] + j))); // 0 - src_radius
+		if (!p.dim3) { // 2D source, displaced from the center in its plane
+			simd::store(p.pos[0] + i, simd::madd(r, ct, simd::set1<V>(p.src[0])));
+			simd::store(p.pos[1] + i, simd::madd(r, st, simd::set1<V>(p.src[1])));
+			simd::store(p.pos[2] + i, simd::set1<V>(p.src[2]));
+		}
+		else { // 3D source
+			V sp, cp;
+			simd::sincos(simd::mul(simd::set1<V>(pi), simd::load<V>(u[2] + j)), sp, cp); // 0 - PI
+			V rs = simd::mul(r, sp);
+			simd::store(p.pos[0] + i, simd::madd(rs, ct, simd::set1<V>(p.src[0])));
+			simd::store(p.pos[1] + i, simd::madd(rs, st, simd::set1<V>(p.src[1])));
+			simd::store(p.pos[2] + i, simd::madd(r, cp, simd::set1<V>(p.src[2])));
+		}
+
+		V sv, cv, sa, ca;
+		simd::sincos(simd::mul(simd::set1<V>(p.max_angle), simd::load<V>(u[4] + j)), sv, cv); // 0 - MaxAngle
+		simd::sincos(simd::mul(simd::set1<V>(two_pi), simd::load<V>(u[5] + j)), sa, ca); // 0 - 2PI
+		V speed = simd::set1<V>(p.ini_vel);
+		sv = simd::mul(sv, speed);
+		simd::store(p.vel[0] + i, simd::mul(cv, speed));
+		simd::store(p.vel[1] + i, simd::mul(sv, ca));
+		simd::store(p.vel[2] + i, simd::mul(sv, sa));
+
+		V ls = simd::madd(simd::set1<V>(2.0f), simd::load<V>(u[3] + j), simd::set1<V>(-0.5f)); // (-1) - 1
+		simd::store(p.life + i, simd::madd(ls, simd::set1<V>(p.lfspan_ptb), simd::set1<V>(p.lifespan)));
+	}
+}
+
 ParticleSystem::ParticleSystem() { // default particle system
 
 	// initializing global parameters for particle system
@@ -23,11 +145,13 @@ ParticleSystem::ParticleSystem() { // default particle system
 	ini_vel = 1.0f;  // initial velocity
 	vel_ptb = 0.0f; // velocity perturbation
 	ini_clr = glm::vec3(0.0f, 0.0f, 0.0f); // initial color
+	emitter = emitters++; // key of the random numbers
+	spawn_frame = 0;
+	store = storage::compact;
+	ring_tail = 0;
+	ring_count = 0;
 
-	Pos.reserve(max_ptc_ct);
-	Vel.reserve(max_ptc_ct);
-	Life.reserve(max_ptc_ct);
-	Clr.reserve(max_ptc_ct);
+	reserveAll();
 }
 
 ParticleSystem::ParticleSystem(float gr, float ls, float lsptb, int mpc, glm::vec3 pos, float sr, src_type st, axis n, float vel, float vptb, glm::vec3 clr) {
@@ -45,47 +169,44 @@ ParticleSystem::ParticleSystem(float gr, float ls, float lsptb, int mpc, glm::ve
 	ini_vel = vel;  // initial velocity
 	vel_ptb = vptb; // velocity perturbation
 	ini_clr = clr; // initial color
+	emitter = emitters++; // key of the random numbers
+	spawn_frame = 0;
+	store = storage::compact;
+	ring_tail = 0;
+	ring_count = 0;
 
-	Pos.reserve(max_ptc_ct);
-	Vel.reserve(max_ptc_ct);
-	Life.reserve(max_ptc_ct);
-	Clr.reserve(max_ptc_ct);
+	reserveAll();
 
 }
 
 // Update the particles in a fluid-like/smoke-like behavior
 void ParticleSystem::update(float dt, ParticleSystem::particle_type t, glm::vec3 obs_loc, float obs_rad) {
-	removeParticles(); // remove the dead particles
+	if (store == storage::ring) expireParticles(); // remove the dead particles
+	else removeParticles();
 	if (generate) spawnParticles(dt); // spawn new particles
-	
-	for (int i = 0; i < Pos.size(); i++) { // update pos, vel, and life (and color)
-		Pos[i] += Vel[i] * dt;
-		if (t == ParticleSystem::particle_type::fluid) Vel[i] += glm::vec3(0, 0, g) * dt;
-		else if (t == ParticleSystem::particle_type::smoke) {
-			Vel[i] += glm::vec3(0, 0, 10) * dt;
-			Vel[i].x *= 0.8;
-			Vel[i].y *= 0.8;
-			Clr[i].g = Life[i] / lifespan;
-		};
-		// if particle type is "others", velocity update is done elsewhere
-		Life[i] -= dt;
-
-		if (collision) {
-			//collision detection
-			glm::vec3 dir = Pos[i] - obs_loc;
-			float dis = glm::length(dir);
-			//printf("Distance: %f \n", dis);
-			if (dis <= obs_rad) { // collide
-				// return to valid state
-				dir /= dis;
-				Pos[i] = obs_loc + dir * (obs_rad + 0.01f);
-				//if fluid particle then reflect
-				if (t == ParticleSystem::particle_type::fluid) {
-					float tmp = glm::dot(Vel[i], dir);
-					Vel[i] -= 2 * tmp * dir;
-					Vel[i] *= 0.5f;
-				}
-			}
+
+	// the type only picks the constants of the kernels
+	float az = 0.0f, drag = 1.0f; // if particle type is "others", velocity update is done elsewhere
+	if (t == ParticleSystem::particle_type::fluid) az = g;
+	else if (t == ParticleSystem::particle_type::smoke) {
+		az = 10.0f;
+		drag = 0.8f;
+	}
+	bool fade = t == ParticleSystem::particle_type::smoke;
+	bool bounce = t == ParticleSystem::particle_type::fluid; // if fluid particle then reflect
+
+	particle_arrays s = { px.data(), py.data(), pz.data(), qx.data(), qy.data(), qz.data(), vx.data(), vy.data(), vz.data(), cg.data(), Life.data() };
+	int start[2], end[2];
+	int r = runs(start, end);
+	for (int k = 0; k < r; k++) {
+		int i = start[k];
+		for (; i + simd::lanes <= end[k]; i += simd::lanes) { // update pos, vel, and life (and color)
+			step_kernel<simd::vfloat>(s, i, dt, az, drag, fade, lifespan);
+			if (collision) collide_kernel<simd::vfloat>(s, i, obs_loc, obs_rad, bounce);
+		}
+		for (; i < end[k]; i++) {
+			step_kernel<float>(s, i, dt, az, drag, fade, lifespan);
+			if (collision) collide_kernel<float>(s, i, obs_loc, obs_rad, bounce);
 		}
 	}
 }
@@ -98,105 +219,249 @@ void ParticleSystem::spawnParticles(float dt) {
 	// determine how many particles to spawn per dt
 	float ppt = genRate * dt;
 
-	// spawn the integral parts of particles
-	for (int i = 0; i < int(ppt); i++) {
-		if (Pos.size() < max_ptc_ct)  spawnOneParticle();
+	// the integral parts of particles, and the "fractional part" now and then, up to the maximum count
+	int live = count();
+	int n = glm::min(int(ppt), max_ptc_ct - live);
+	if (src_radius * rng::uniform(0, spawn_frame, 2, emitter, 0) < ppt - int(ppt) && live + n < max_ptc_ct) n++;
+	if (n <= 0) {
+		spawn_frame++;
+		return;
 	}
-	
-	// spawn the "fractional part"
-	if (src_radius * static_cast <float> (rand()) / static_cast <float> (RAND_MAX) < ppt - int(ppt) && (Pos.size() < max_ptc_ct))
-		spawnOneParticle();
-}
-
-void ParticleSystem::spawnOneParticle() {
-
-	// randomly initialize properties of a single particle
-	Pos.push_back(sampleSource()); 
-	Vel.push_back(sampleVelocity());
-	Life.push_back(sampleLifespan());
-	Clr.push_back(ini_clr);
 
+	simd::aligned_floats* colors[3] = { &cr, &cg, &cb }; // the same for all of them
+	if (store == storage::ring) {
+		// append at the head, past the end of the arrays the new particles go on from slot 0
+		int head = slot(live);
+		int n1 = glm::min(n, max_ptc_ct - head);
+		for (int c = 0; c < 3; c++) {
+			std::fill(colors[c]->begin() + head, colors[c]->begin() + head + n1, ini_clr[c]);
+			std::fill(colors[c]->begin(), colors[c]->begin() + n - n1, ini_clr[c]);
+		}
+		sampleParticles(head, n1, 0);
+		sampleParticles(0, n - n1, n1);
+		ring_count += n;
+	}
+	else {
+		// grow every array once
+		simd::aligned_floats* arrays[attrib_ct];
+		attribArrays(arrays);
+		for (int a = 0; a < attrib_ct; a++) arrays[a]->resize(live + n);
+		for (int c = 0; c < 3; c++) std::fill(colors[c]->begin() + live, colors[c]->end(), ini_clr[c]);
+		sampleParticles(live, n, 0);
+	}
+	spawn_frame++;
 }
 
+// Stream compaction: the n - dead survivors must end up in the first n - dead slots, so every dead particle
+// in there (a hole) takes a survivor from behind them (a mover); count both per block, turn the counts into
+// where each block's holes and movers go in two lists with a prefix sum, scatter them, then move the k-th
+// mover into the k-th hole in every array in one pass; only the dead and the survivors they trade places
+// with are moved, and the blocks do not depend on the threads, so the result is always the same
 void ParticleSystem::removeParticles() {
+	int n = count();
+	int blocks = (n + compact_block - 1) / compact_block;
+	hole_start.resize(blocks + 1);
+	mover_start.resize(blocks + 1);
 
-	vector<int> ind; // indices of dead particles
-	// Cycle through the list of lifespan and remove the dead particles
 	#pragma omp parallel for
-	for (int i = Life.size() - 1; i >= 0; i--) {
-		if (Life[i] <= 0) ind.push_back(i); // the indices are recorded in reversed order
-	}
-	
-	for (int i = 0; i < ind.size(); i++) {
-		int last = Pos.size() - 1;
-		Pos[ind[i]] = Pos[last];
-		Pos.pop_back();
-		Vel[ind[i]] = Vel[last];
-		Vel.pop_back();
-		Life[ind[i]] = Life[last];
-		Life.pop_back();
-		Clr[ind[i]] = Clr[last];
-		Clr.pop_back();
-	}
-}
-
-glm::vec3 ParticleSystem::sampleSource() {
-
-	glm::vec3 pos = src_pos;
-	float theta = 2 * M_PI * static_cast <float> (rand()) / static_cast <float> (RAND_MAX);  // 0 - 2PI
-	float r = sqrt(src_radius * static_cast <float> (rand()) / static_cast <float> (RAND_MAX)); // 0 - src_radius
-
-	if (src_dim == src_type::dim2) { // 2D source
-		float v1 = r * cos(theta); // displacement from the center of the source
-		float v2 = r * sin(theta);
-
-		// determine final spawn location
-		switch (src_normal) {
-		case axis::X:
-			pos += glm::vec3(0, v2, v1); break;
-		case axis::Y:
-			pos += glm::vec3(v1, 0, v2); break;
-		default:
-			pos += glm::vec3(v1, v2, 0);
+	for (int b = 0; b < blocks; b++) {
+		int end = glm::min(n, (b + 1) * compact_block);
+		int dead = 0;
+		for (int i = b * compact_block; i < end; i++) dead += Life[i] <= 0;
+		hole_start[b + 1] = dead;
+	}
+
+	hole_start[0] = 0;
+	for (int b = 0; b < blocks; b++) hole_start[b + 1] += hole_start[b]; // prefix sum
+	int live = n - hole_start[blocks];
+	if (live == n) return; // nothing died
+
+	// blocks below the new end only have holes, blocks past it only movers, and the block across it both
+	int cut = live / compact_block;
+	int dead_before = 0;
+	for (int b = 0; b < blocks; b++) {
+		int size = glm::min(n, (b + 1) * compact_block) - b * compact_block;
+		int dead = hole_start[b + 1] - dead_before;
+		dead_before = hole_start[b + 1];
+		mover_start[b + 1] = b > cut ? size - dead : 0;
+		hole_start[b + 1] = b < cut ? dead : 0;
+	}
+	if (cut < blocks) {
+		int end = glm::min(n, (cut + 1) * compact_block);
+		for (int i = cut * compact_block; i < end; i++) {
+			if (i < live) hole_start[cut + 1] += Life[i] <= 0;
+			else mover_start[cut + 1] += !(Life[i] <= 0);
 		}
 	}
-	else { // 3D source
-		float phi = M_PI * static_cast <float> (rand()) / static_cast <float> (RAND_MAX);  // 0 - PI
-		pos += r * glm::vec3(cos(theta) * sin(phi), sin(theta) * sin(phi), cos(phi));
+	hole_start[0] = mover_start[0] = 0;
+	for (int b = 0; b < blocks; b++) { // prefix sums
+		hole_start[b + 1] += hole_start[b];
+		mover_start[b + 1] += mover_start[b];
 	}
+	int moves = hole_start[blocks]; // as many as mover_start[blocks]
+	hole.resize(moves);
+	mover.resize(moves);
 
-	return pos;
-}
+	#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		int h = hole_start[b], m = mover_start[b];
+		if (h == hole_start[b + 1] && m == mover_start[b + 1]) continue; // nothing to trade
+		int end = glm::min(n, (b + 1) * compact_block);
+		for (int i = b * compact_block; i < end; i++) {
+			bool dead = Life[i] <= 0;
+			if (i < live && dead) hole[h++] = i;
+			else if (i >= live && !dead) mover[m++] = i;
+		}
+	}
 
-glm::vec3 ParticleSystem::sampleVelocity() {
+	simd::aligned_floats* arrays[attrib_ct];
+	attribArrays(arrays);
+	float* a[attrib_ct];
+	for (int k = 0; k < attrib_ct; k++) a[k] = arrays[k]->data();
 
-	glm::vec3 vel;
+	#pragma omp parallel for
+	for (int k = 0; k < moves; k++) {
+		for (int j = 0; j < attrib_ct; j++) a[j][hole[k]] = a[j][mover[k]];
+	}
+	for (int k = 0; k < attrib_ct; k++) arrays[k]->resize(live);
+}
 
-	float theta = vel_ptb * M_PI * static_cast <float> (rand()) / (static_cast <float> (180 * RAND_MAX)); // 0 - MaxAngle
-	float phi = 2 * M_PI * static_cast <float> (rand()) / static_cast <float> (RAND_MAX); // 0 - 2PI
+// The particles of a ring are in the order they were born, so the dead are mostly the oldest: the tail moves past them.
+// A particle older than a dead one has lived at least as long, so it has no more life left than the spread of the
+// lifespans; the first survivor with more than that left has no dead particle behind it. The survivors up to there
+// move up over the dead, keeping their order, so every particle leaves in the update after it died, as in compaction
+void ParticleSystem::expireParticles() {
+	float spread = 2.0f * fabs(lfspan_ptb) + 1e-3f; // lifespans are within lifespan - ptb / 2 and lifespan + 3 ptb / 2, the rest is rounding
+	int m = 0;
+	while (m < ring_count && Life[slot(m)] <= spread) m++;
+
+	simd::aligned_floats* arrays[attrib_ct];
+	attribArrays(arrays);
+	int to = m - 1;
+	for (int i = m - 1; i >= 0; i--) {
+		int from = slot(i);
+		if (Life[from] <= 0) continue;
+		if (to != i) {
+			int dst = slot(to);
+			for (int a = 0; a < attrib_ct; a++) (*arrays[a])[dst] = (*arrays[a])[from];
+		}
+		to--;
+	}
+	int dead = to + 1; // every slot before the survivors
+	ring_tail = slot(dead);
+	ring_count -= dead;
+}
 
-	float v1 = cos(theta);
-	float v2 = sin(theta) * cos(phi);
-	float v3 = sin(theta) * sin(phi);
+void ParticleSystem::set_storage(storage s) {
+	if (s == store) return;
+
+	simd::aligned_floats* arrays[attrib_ct];
+	attribArrays(arrays);
+	if (s == storage::ring) {
+		// compaction mixed up the order they were born in, so the survivors go by the life they have left,
+		// which is all expireParticles() relies on
+		removeParticles();
+		int n = count();
+		vector<int> order(n);
+		for (int i = 0; i < n; i++) order[i] = i;
+		stable_sort(order.begin(), order.end(), [&](int a, int b) { return Life[a] < Life[b]; });
+		for (int a = 0; a < attrib_ct; a++) {
+			simd::aligned_floats sorted(max_ptc_ct);
+			for (int i = 0; i < n; i++) sorted[i] = (*arrays[a])[order[i]];
+			arrays[a]->swap(sorted);
+		}
+		ring_tail = 0;
+		ring_count = n;
+	}
+	else {
+		unwrapRing();
+		for (int a = 0; a < attrib_ct; a++) arrays[a]->resize(ring_count);
+	}
+	store = s;
+}
 
-	switch (src_normal) {
-	case axis::X:
-		vel = glm::vec3(v1, v2, v3); break;
-	case axis::Y:
-		vel = glm::vec3(v3, v1, v2); break;
-	default:
-		vel = glm::vec3(v2, v3, v1);
+int ParticleSystem::slot(int i) const {
+	if (store != storage::ring) return i;
+	int s = ring_tail + i;
+	return s < max_ptc_ct ? s : s - max_ptc_ct;
+}
+
+int ParticleSystem::runs(int start[2], int end[2]) const {
+	start[0] = slot(0);
+	if (store != storage::ring) {
+		end[0] = count();
+		return 1;
 	}
+	int head = ring_tail + ring_count;
+	end[0] = glm::min(head, max_ptc_ct);
+	if (head <= max_ptc_ct) return 1;
+	start[1] = 0;
+	end[1] = head - max_ptc_ct;
+	return 2;
+}
 
-	vel *= ini_vel;
-	return vel;
+void ParticleSystem::unwrapRing() {
+	if (ring_tail == 0) return;
+	simd::aligned_floats* arrays[attrib_ct];
+	attribArrays(arrays);
+	for (int a = 0; a < attrib_ct; a++) std::rotate(arrays[a]->begin(), arrays[a]->begin() + ring_tail, arrays[a]->end());
+	ring_tail = 0;
 }
 
-float ParticleSystem::sampleLifespan() {
-	float ls = 2 * static_cast <float> (rand()) / static_cast <float> (RAND_MAX) - 0.5; // (-1) - 1
-	ls *= lfspan_ptb;
-	ls += lifespan;
-	return ls;
+void ParticleSystem::reserveAll() {
+	simd::aligned_floats* arrays[attrib_ct];
+	attribArrays(arrays);
+	for (int a = 0; a < attrib_ct; a++) arrays[a]->reserve(max_ptc_ct);
+}
+
+void ParticleSystem::attribArrays(simd::aligned_floats* arrays[attrib_ct]) {
+	simd::aligned_floats* all[attrib_ct] = { &px, &py, &pz, &qx, &qy, &qz, &vx, &vy, &vz, &cr, &cg, &cb, &Life };
+	for (int a = 0; a < attrib_ct; a++) arrays[a] = all[a];
+}
+
+// Draw the n new particles from slot first on, straight into the arrays, one register of them at a time:
+// the k-th new particle of the frame takes the uniforms of counters (k, spawn_frame, 0) and (k, spawn_frame, 1)
+// under the key of this emitter, so any thread can draw any of them
+void ParticleSystem::sampleParticles(int first, int n, int drawn) {
+	// the axes of the source plane and of the velocity, from the source normal
+	int plane[3] = { 0, 1, 2 }; // the two axes the disc spans, then the normal
+	if (src_dim == src_type::dim2) {
+		if (src_normal == axis::X) plane[0] = 2, plane[2] = 0;
+		else if (src_normal == axis::Y) plane[1] = 2, plane[2] = 1;
+	}
+	int normal = src_normal == axis::X ? 0 : (src_normal == axis::Y ? 1 : 2); // the velocity cycles from the normal
+
+	float* pos3[3] = { px.data(), py.data(), pz.data() };
+	float* vel3[3] = { vx.data(), vy.data(), vz.data() };
+	spawn_params p;
+	for (int a = 0; a < 3; a++) {
+		p.pos[a] = pos3[plane[a]];
+		p.src[a] = src_pos[plane[a]];
+		p.vel[a] = vel3[(normal + a) % 3];
+	}
+	p.life = Life.data();
+	p.dim3 = src_dim == src_type::dim3;
+	p.src_radius = src_radius;
+	p.max_angle = vel_ptb * float(M_PI) / 180.0f;
+	p.ini_vel = ini_vel;
+	p.lifespan = lifespan;
+	p.lfspan_ptb = lfspan_ptb;
+
+	int chunks = (n + simd::lanes - 1) / simd::lanes;
+	#pragma omp parallel for
+	for (int c = 0; c < chunks; c++) {
+		int k0 = c * simd::lanes;
+		int m = glm::min(simd::lanes, n - k0); // the last one may be short
+		float u[6][simd::lanes];
+		for (int k = 0; k < m; k++) {
+			float r[8];
+			rng::uniform4(r, drawn + k0 + k, spawn_frame, 0, 0, emitter, 0);
+			rng::uniform4(r + 4, drawn + k0 + k, spawn_frame, 1, 0, emitter, 0);
+			for (int a = 0; a < 6; a++) u[a][k] = r[a];
+		}
+		if (m == simd::lanes) sample_kernel<simd::vfloat>(p, u, 0, first + k0);
+		else for (int k = 0; k < m; k++) sample_kernel<float>(p, u, k, first + k0 + k);
+	}
 }
 
 void ParticleSystem::set_gen(bool b) {
@@ -205,4 +470,69 @@ void ParticleSystem::set_gen(bool b) {
 
 void ParticleSystem::set_collision(bool b) {
 	collision = b;
+}
+
+int ParticleSystem::count() const {
+	return store == storage::ring ? ring_count : Life.size();
+}
+
+glm::vec3 ParticleSystem::pos(int i) const {
+	i = slot(i);
+	return glm::vec3(px[i], py[i], pz[i]);
+}
+
+glm::vec3 ParticleSystem::vel(int i) const {
+	i = slot(i);
+	return glm::vec3(vx[i], vy[i], vz[i]);
+}
+
+glm::vec3 ParticleSystem::color(int i) const {
+	i = slot(i);
+	return glm::vec3(cr[i], cg[i], cb[i]);
+}
+
+void ParticleSystem::write_pos(float* out) const {
+	int n = count();
+	for (int i = 0; i < n; i++) {
+		int j = slot(i);
+		out[3 * i] = px[j];
+		out[3 * i + 1] = py[j];
+		out[3 * i + 2] = pz[j];
+	}
+}
+
+float* ParticleSystem::pos_array(axis a) {
+	if (store == storage::ring && ring_tail + ring_count > max_ptc_ct) unwrapRing();
+	switch (a) {
+	case axis::X:
+		return px.data() + slot(0);
+	case axis::Y:
+		return py.data() + slot(0);
+	default:
+		return pz.data() + slot(0);
+	}
+}
+
+float* ParticleSystem::start_array(axis a) {
+	if (store == storage::ring && ring_tail + ring_count > max_ptc_ct) unwrapRing();
+	switch (a) {
+	case axis::X:
+		return qx.data() + slot(0);
+	case axis::Y:
+		return qy.data() + slot(0);
+	default:
+		return qz.data() + slot(0);
+	}
+}
+
+float* ParticleSystem::vel_array(axis a) {
+	if (store == storage::ring && ring_tail + ring_count > max_ptc_ct) unwrapRing();
+	switch (a) {
+	case axis::X:
+		return vx.data() + slot(0);
+	case axis::Y:
+		return vy.data() + slot(0);
+	default:
+		return vz.data() + slot(0);
+	}
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include "../../glm/gtc/matrix_transform.hpp"
 #include "../../glm/gtc/type_ptr.hpp"
 
+#include "../../Tools/SIMD.h"
+
 using namespace std;
 
 enum class axis {X, Y, Z};
@@ -17,9 +19,7 @@ class ParticleSystem
 
 public:
 	enum particle_type { fluid, smoke, others };
-
-	vector<glm::vec3> Pos;
-	vector<glm::vec3> Clr;
+	enum class storage { compact, ring }; // how the dead particles leave, see set_storage()
 
 	ParticleSystem();
 
@@ -33,6 +33,21 @@ public:
 
 	void set_collision(bool b); // set whether to consider collision
 
+	// compact (the default) moves survivors into the places of the dead every frame, ring keeps the particles
+	// in the order they were born in arrays of max_ptc_ct and drops the oldest, for emitters whose particles live
+	// about as long as each other; either way the dead leave in the next update, and count() is the live ones
+	void set_storage(storage s);
+
+	// accessors, the particles are stored as separate x/y/z arrays
+	int count() const; // number of live particles
+	glm::vec3 pos(int i) const; // position of particle i
+	glm::vec3 vel(int i) const; // velocity of particle i
+	glm::vec3 color(int i) const; // color of particle i
+	void write_pos(float* out) const; // interleaved x, y, z of every particle into out, e.g. a vertex buffer
+	float* pos_array(axis a); // the x, y or z array of the positions, count() long, for other bodies (e.g. a Cloth) to push the particles; rotates a wrapped ring first
+	float* vel_array(axis a); // ... of the velocities
+	float* start_array(axis a); // ... of the positions at the start of the last update(), where the straight path of each particle began
+
 private:
 	// particle system global parameters
 	float genRate;
@@ -49,21 +64,46 @@ private:
 	float vel_ptb; // velocity perturbation (in angles)
 	glm::vec3 ini_clr; // initial color
 
-	// lists of information for each particle
-	vector<glm::vec3> Vel;
-	vector<float> Life;
+	// lists of information for each particle, one array per component so update() runs on whole SIMD registers
+	simd::aligned_floats px, py, pz; // positions
+	simd::aligned_floats qx, qy, qz; // positions at the start of the last update()
+	simd::aligned_floats vx, vy, vz; // velocities
+	simd::aligned_floats cr, cg, cb; // colors
+	simd::aligned_floats Life;
+	static const int attrib_ct = 13; // number of arrays above
+
+	// stream compaction of the dead particles (removeParticles)
+	static const int compact_block = 4096; // particles per block, fixed so the result does not depend on the threads
+	vector<int> hole_start, mover_start; // where the holes and the movers of every block go in the lists below
+	vector<int> hole, mover; // dead particles before the new end, and the survivors after it that take their place
+
+	// ring storage, the particles are slots ring_tail, ring_tail + 1, ... (mod max_ptc_ct), oldest first
+	storage store;
+	int ring_tail; // slot of the oldest particle
+	int ring_count; // number of particles in the ring
+
+	// counter-based sampling (Tools/Random.h), every new particle is keyed by the emitter, the frame and its index in it
+	static uint32_t emitters; // particle systems made so far
+	uint32_t emitter; // id of this one
+	uint32_t spawn_frame; // spawnParticles() calls so far
 
 	// private functions for particle generation and update
-	glm::vec3 sampleSource(); // sample the particle source
-
-	glm::vec3 sampleVelocity(); // sample initial velocity
-
-	float sampleLifespan(); // sample lifespan
+	void sampleParticles(int first, int n, int drawn); // sample the source, initial velocity and lifespan of n particles into slots first on (the drawn-th of this frame on), on any number of threads
 
 	void spawnParticles(float dt); // spawn particles per timestep
-	
-	void spawnOneParticle(); // spawn a paticle
 
 	void removeParticles(); // remove the dead particles per timestep
 
+	void expireParticles(); // remove the dead particles from the oldest end of the ring
+
+	int slot(int i) const; // slot of particle i in the arrays
+
+	int runs(int start[2], int end[2]) const; // the one or two ranges of slots the particles are in, returns how many
+
+	void unwrapRing(); // rotate the ring so the particles are slots 0 .. count() - 1
+
+	void reserveAll(); // reserve max_ptc_ct in every array
+
+	void attribArrays(simd::aligned_floats* arrays[attrib_ct]); // every per-particle array
+
 };
\ No newline at end of file
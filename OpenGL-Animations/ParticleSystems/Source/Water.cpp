@@ -329,7 +329,7 @@ void update(float dt, GLint shader1, GLint shader2, GLint vao1, GLint vao2) {
 
 void computePhysics(float dt) {
     water.update(dt, ParticleSystem::particle_type::fluid, sph_loc, sph_rad);
-    //printf("Particle Count: %i \n", water.Pos.size());
+    //printf("Particle Count: %i \n", water.count());
 }
 
 void set_camera() {
@@ -345,12 +345,12 @@ void set_camera() {
 
 void draw_particles() {
     // iterate through all particles
-    for (int i = 0; i < water.Pos.size(); i++) {
+    for (int i = 0; i < water.count(); i++) {
         glm::mat4 model = glm::mat4();
-        model = glm::translate(model, water.Pos[i]);
-        glPointSize(autosize(cam_loc, water.Pos[i], 60.0f));
+        model = glm::translate(model, water.pos(i));
+        glPointSize(autosize(cam_loc, water.pos(i), 60.0f));
         glUniformMatrix4fv(uniModel, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform3f(uniColor, water.Clr[i].r, water.Clr[i].g, water.Clr[i].b);
+        glUniform3f(uniColor, water.color(i).r, water.color(i).g, water.color(i).b);
         glDrawArrays(GL_POINTS, 0, 1); //(Primitives, Which VBO, Number of vertices)
     }
 
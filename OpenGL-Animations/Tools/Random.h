@@ -0,0 +1,45 @@
+// Counter-based random numbers: Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+// every draw is a pure function of a counter and a key, so there is no state to share between threads,
+// and a sample keyed by e.g. (emitter, frame, particle) comes out the same on any number of threads
+// written by Yuxuan Huang
+
+#pragma once
+
+#include <cstdint>
+
+namespace rng {
+
+	// 4 random words from the 4-word counter c and the 2-word key k, in place of c
+	inline void philox4x32(uint32_t c[4], uint32_t k0, uint32_t k1) {
+		for (int round = 0; round < 10; round++) {
+			uint64_t p0 = uint64_t(0xD2511F53u) * c[0];
+			uint64_t p1 = uint64_t(0xCD9E8D57u) * c[2];
+			uint32_t x0 = uint32_t(p1 >> 32) ^ c[1] ^ k0;
+			uint32_t x1 = uint32_t(p1);
+			uint32_t x2 = uint32_t(p0 >> 32) ^ c[3] ^ k1;
+			uint32_t x3 = uint32_t(p0);
+			c[0] = x0; c[1] = x1; c[2] = x2; c[3] = x3;
+			k0 += 0x9E3779B9u; // Weyl sequence of the key
+			k1 += 0xBB67AE85u;
+		}
+	}
+
+	// [0, 1) from the top 24 bits of a word, every value a float represents exactly
+	inline float unit(uint32_t x) {
+		return float(x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// 4 uniforms in [0, 1) for counter (c0, c1, c2, c3) and key (k0, k1)
+	inline void uniform4(float u[4], uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t k0, uint32_t k1) {
+		uint32_t c[4] = { c0, c1, c2, c3 };
+		philox4x32(c, k0, k1);
+		for (int i = 0; i < 4; i++) u[i] = unit(c[i]);
+	}
+
+	// one uniform in [0, 1), for the odd draw that is not worth a batch
+	inline float uniform(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t k0, uint32_t k1) {
+		float u[4];
+		uniform4(u, c0, c1, c2, 0, k0, k1);
+		return u[0];
+	}
+}
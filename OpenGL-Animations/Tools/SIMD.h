@@ -0,0 +1,145 @@
+// A thin wrapper over the SIMD instruction sets used by the simulations
+// AVX2 on x86, NEON on ARM64, plain floats everywhere else
+// written by Yuxuan Huang
+
+#pragma once
+
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <new>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+
+namespace simd {
+
+	// kernels are written once as templates over the lane type,
+	// then instantiated with vfloat for the main loop and float for the tail
+#if defined(SIMD_AVX2)
+	const int lanes = 8;
+	typedef __m256 vfloat;
+#elif defined(SIMD_NEON)
+	const int lanes = 4;
+	typedef float32x4_t vfloat;
+#else
+	const int lanes = 1;
+	typedef float vfloat;
+#endif
+	const int alignment = 32; // enough for every supported instruction set
+
+	// scalar versions, always available
+	template<class V> V load(const float* p);
+	template<class V> V set1(float s);
+	template<> inline float load<float>(const float* p) { return *p; }
+	template<> inline float set1<float>(float s) { return s; }
+	inline void store(float* p, float v) { *p = v; }
+	inline float add(float a, float b) { return a + b; }
+	inline float sub(float a, float b) { return a - b; }
+	inline float mul(float a, float b) { return a * b; }
+	inline float div(float a, float b) { return a / b; }
+	inline float madd(float a, float b, float c) { return a * b + c; } // a * b + c
+	inline float sqrt(float a) { return std::sqrt(a); }
+	inline float min(float a, float b) { return a < b ? a : b; }
+	inline float max(float a, float b) { return a > b ? a : b; }
+	inline float le(float a, float b) { return a <= b ? 1.0f : 0.0f; } // 1 where a <= b, 0 elsewhere
+	inline float round(float a) { return std::nearbyint(a); } // to the nearest integer, ties to even
+	inline bool any(float a) { return a != 0.0f; } // true if any lane is not 0, e.g. of a mask from le()
+
+#if defined(SIMD_AVX2)
+	template<> inline __m256 load<__m256>(const float* p) { return _mm256_loadu_ps(p); }
+	template<> inline __m256 set1<__m256>(float s) { return _mm256_set1_ps(s); }
+	inline void store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+	inline __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+	inline __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+	inline __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+	inline __m256 div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__) || defined(_MSC_VER)
+	inline __m256 madd(__m256 a, __m256 b, __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+	inline __m256 madd(__m256 a, __m256 b, __m256 c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+	inline __m256 sqrt(__m256 a) { return _mm256_sqrt_ps(a); }
+	inline __m256 min(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+	inline __m256 max(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+	inline __m256 le(__m256 a, __m256 b) { return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ), _mm256_set1_ps(1.0f)); }
+	inline __m256 round(__m256 a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	inline bool any(__m256 a) { return _mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_NEQ_OQ)) != 0; }
+#elif defined(SIMD_NEON)
+	template<> inline float32x4_t load<float32x4_t>(const float* p) { return vld1q_f32(p); }
+	template<> inline float32x4_t set1<float32x4_t>(float s) { return vdupq_n_f32(s); }
+	inline void store(float* p, float32x4_t v) { vst1q_f32(p, v); }
+	inline float32x4_t add(float32x4_t a, float32x4_t b) { return vaddq_f32(a, b); }
+	inline float32x4_t sub(float32x4_t a, float32x4_t b) { return vsubq_f32(a, b); }
+	inline float32x4_t mul(float32x4_t a, float32x4_t b) { return vmulq_f32(a, b); }
+	inline float32x4_t div(float32x4_t a, float32x4_t b) { return vdivq_f32(a, b); }
+	inline float32x4_t madd(float32x4_t a, float32x4_t b, float32x4_t c) { return vfmaq_f32(c, a, b); }
+	inline float32x4_t sqrt(float32x4_t a) { return vsqrtq_f32(a); }
+	inline float32x4_t min(float32x4_t a, float32x4_t b) { return vminq_f32(a, b); }
+	inline float32x4_t max(float32x4_t a, float32x4_t b) { return vmaxq_f32(a, b); }
+	inline float32x4_t le(float32x4_t a, float32x4_t b) { return vreinterpretq_f32_u32(vandq_u32(vcleq_f32(a, b), vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))); }
+	inline float32x4_t round(float32x4_t a) { return vrndnq_f32(a); }
+	inline bool any(float32x4_t a) { return vmaxvq_f32(vabsq_f32(a)) != 0.0f; }
+#endif
+
+	// sine and cosine of x together, to within a few float ulps: x is brought into [-pi, pi],
+	// and the Taylor series of the half angle (within [-pi/2, pi/2]) give both through the double angle formulas
+	template<class V>
+	inline void sincos(V x, V& s, V& c) {
+		x = sub(x, mul(set1<V>(6.28318531f), round(mul(x, set1<V>(0.159154943f)))));
+		V h = mul(x, set1<V>(0.5f));
+		V h2 = mul(h, h);
+		V sh = madd(h2, set1<V>(-2.50521084e-8f), set1<V>(2.75573192e-6f)); // 1 / 11!, 1 / 9!, ...
+		sh = madd(h2, sh, set1<V>(-1.98412698e-4f));
+		sh = madd(h2, sh, set1<V>(8.33333333e-3f));
+		sh = madd(h2, sh, set1<V>(-1.66666667e-1f));
+		sh = madd(mul(h2, sh), h, h);
+		V ch = madd(h2, set1<V>(2.08767570e-9f), set1<V>(-2.75573192e-7f)); // 1 / 12!, 1 / 10!, ...
+		ch = madd(h2, ch, set1<V>(2.48015873e-5f));
+		ch = madd(h2, ch, set1<V>(-1.38888889e-3f));
+		ch = madd(h2, ch, set1<V>(4.16666667e-2f));
+		ch = madd(h2, ch, set1<V>(-0.5f));
+		ch = madd(h2, ch, set1<V>(1.0f));
+		V sc = mul(sh, ch);
+		s = add(sc, sc);
+		c = sub(mul(ch, ch), mul(sh, sh));
+	}
+
+	// allocator that keeps every array aligned to a full register
+	template<class T>
+	struct aligned_allocator {
+		typedef T value_type;
+
+		aligned_allocator() {}
+		template<class U> aligned_allocator(const aligned_allocator<U>&) {}
+
+		T* allocate(size_t n) {
+			// over-allocate and keep the original pointer right before the aligned block
+			void* raw = std::malloc(n * sizeof(T) + alignment + sizeof(void*));
+			if (!raw) throw std::bad_alloc();
+			uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(void*);
+			uintptr_t aligned = (start + alignment - 1) & ~uintptr_t(alignment - 1);
+			reinterpret_cast<void**>(aligned)[-1] = raw;
+			return reinterpret_cast<T*>(aligned);
+		}
+
+		void deallocate(T* p, size_t) {
+			if (p) std::free(reinterpret_cast<void**>(p)[-1]);
+		}
+
+		template<class U> struct rebind { typedef aligned_allocator<U> other; };
+	};
+
+	template<class T, class U>
+	bool operator==(const aligned_allocator<T>&, const aligned_allocator<U>&) { return true; }
+	template<class T, class U>
+	bool operator!=(const aligned_allocator<T>&, const aligned_allocator<U>&) { return false; }
+
+	typedef std::vector<float, aligned_allocator<float> > aligned_floats;
+}